@@ -19,6 +19,7 @@
  */
 #include "LAN.h"
 #include "LAN_common.h"
+#include "LAN_misc.h"
 
 // various constants used everywhere
 int ARTNET_PORT = 6454;
@@ -47,23 +48,20 @@ uint8_t MIN_PACKET_SIZE = 10;
  * Init a new ArtNet node.
  */
 int LAN_init(artnet_node_t *node) {
+    uint8_t i;
 
-    memset(node, 0x00, sizeof(node));
+    memset(node, 0x00, sizeof(*node));
 
-    node->swin[0] = 0x00;
-    node->swin[1] = 0x01;
-    node->swin[2] = 0x02;
-    node->swin[3] = 0x03;
-    node->swout[0] = 0x00;
-    node->swout[1] = 0x01;
-    node->swout[2] = 0x02;
-    node->swout[3] = 0x03;
+    for (i = 0; i < ARTNET_MAX_NODE_PORTS; i++) {
+        node->swin[i] = i & 0x0F;
+        node->swout[i] = i & 0x0F;
+    }
 
-    memset(node->ports.types, 0x00, 4);
+    memset(node->ports.types, 0x00, sizeof(node->ports.types));
     node->ports.types[0] = 0x80;
 
-    memset(node->ports.input, 0x00, 4);
-    memset(node->ports.output, 0x00, 4);
+    memset(node->ports.input, 0x00, sizeof(node->ports.input));
+    memset(node->ports.output, 0x00, sizeof(node->ports.output));
     node->ports.input[0] = 0x02;
 
 
@@ -80,19 +78,62 @@ int LAN_init(artnet_node_t *node) {
     node->swmacro    = 0;
     node->swremote   = 0;
 
+    node->reply_max_delay = ARTNET_REPLY_DELAY_MS;
+#ifdef ARTNET_FEATURE_INPUT
+    node->tx_keepalive = ARTNET_TX_KEEPALIVE_MS;
+#endif
+
     node->dmx_callback = NULL;
+    memset(node->port_callback, 0x00, sizeof(node->port_callback));
+    memset(node->view_callback, 0x00, sizeof(node->view_callback));
+    memset(node->merge, 0x00, sizeof(node->merge));
+    memset(node->seq, 0x00, sizeof(node->seq));
+    memset(node->last_frame, 0x00, sizeof(node->last_frame));
+    memset(node->sync, 0x00, sizeof(node->sync));
+    memset(node->queue, 0x00, sizeof(node->queue));
+    memset(node->interp, 0x00, sizeof(node->interp));
+    for (i = 0; i < ARTNET_MAX_NODE_PORTS; i++)
+        node->loss[i].timeout = ARTNET_LOSS_TIMEOUT_MS;
+    node->loss_ms = artnet_misc_time_ms();
+    LAN_update_port_map(node);
 
     node->status = ARTNET_ON;
 
     return ARTNET_EOK;
 }
 
+/*
+ * Send and receive through transport, see LAN_network.cpp for the mbed
+ * socket and LAN_posix.cpp for the host one.
+ */
+void LAN_set_transport(artnet_node_t *node, artnet_transport_t *transport) {
+    node->transport = transport;
+}
+
+/*
+ * Net and subnet of the first page of ports.
+ */
 void LAN_set_port(artnet_node_t *node, uint8_t subnet_hi, uint8_t subnet_lo) {
-    node->subnet_hi = subnet_hi;
-    node->subnet_lo = subnet_lo;
+    LAN_set_page(node, 0, subnet_hi, subnet_lo);
+}
+
+/*
+ * Net and subnet of a page of ARTNET_MAX_PORTS ports. Page n holds
+ * ports n * ARTNET_MAX_PORTS and up, and answers ArtPolls with bind
+ * index n + 1.
+ */
+int LAN_set_page(artnet_node_t *node, uint8_t page, uint8_t net, uint8_t subnet) {
+    if (page >= ARTNET_MAX_PAGES)
+        return ARTNET_EARG;
+
+    node->subnet_hi[page] = net;
+    node->subnet_lo[page] = subnet;
+    LAN_update_port_map(node);
+    LAN_invalidate_reply(node);
+    return ARTNET_EOK;
 }
 
-void LAN_set_dmx(artnet_node_t *node, uint8_t dstart, uint8_t dfootprint) {
+void LAN_set_dmx(artnet_node_t *node, uint16_t dstart, uint16_t dfootprint) {
     node->dmx_start = dstart;
     node->dmx_footprint = dfootprint;
 }
@@ -101,6 +142,59 @@ void LAN_set_dmx_callback(artnet_node_t *node, void (*cb)(uint16_t port, uint8_t
     node->dmx_callback = cb;
 }
 
+/*
+ * Set the callback for a single output port. Ports without their own
+ * callback fall back to the one given to LAN_set_dmx_callback.
+ */
+int LAN_set_port_dmx_callback(artnet_node_t *node, uint8_t port, void (*cb)(uint16_t port, uint8_t *dmx)) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    node->port_callback[port] = cb;
+    return ARTNET_EOK;
+}
+
+/*
+ * Set a callback receiving the whole universe of a port as a view into
+ * the receive buffer. When set, it replaces the sliced callbacks above
+ * for that port.
+ */
+int LAN_set_dmx_view_callback(artnet_node_t *node, uint8_t port, artnet_dmx_view_callback_t cb) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    node->view_callback[port] = cb;
+    return ARTNET_EOK;
+}
+
+/*
+ * Enable an output port and patch it to a universe (the low nibble of
+ * the Port-Address, net and subnet are those of the port's page).
+ */
+int LAN_set_port_universe(artnet_node_t *node, uint8_t port, uint8_t universe) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    node->swout[port] = universe & 0x0F;
+    node->ports.types[port] |= ARTNET_ENABLE_OUTPUT;
+    LAN_update_port_map(node);
+    LAN_invalidate_reply(node);
+    return ARTNET_EOK;
+}
+
+/*
+ * Disable an output port, DMX for its universe is no longer delivered.
+ */
+int LAN_clear_port(artnet_node_t *node, uint8_t port) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    node->ports.types[port] &= ~ARTNET_ENABLE_OUTPUT;
+    LAN_update_port_map(node);
+    LAN_invalidate_reply(node);
+    return ARTNET_EOK;
+}
+
 void LAN_set_network(artnet_node_t *node, in_addr ip,
         in_addr bcast, in_addr gateway, in_addr netmask, uint8_t *mac_addr) {
 
@@ -110,37 +204,263 @@ void LAN_set_network(artnet_node_t *node, in_addr ip,
     node->subnet_mask = netmask;
 
     memcpy(node->mac_addr, mac_addr, ARTNET_MAC_SIZE);
+    LAN_invalidate_reply(node);
+
+    // nodes on the same network must not pick the same reply delays
+    node->rand_state = ip.s_addr ^ ((uint32_t) mac_addr[4] << 24) ^ ((uint32_t) mac_addr[5] << 16);
+}
+
+/*
+ * Send the ArtPollReplies to the subscribed controllers, as a single
+ * broadcast if one of them asked for it, or to everyone if always is
+ * set and nobody subscribed.
+ */
+static int notify(artnet_node_t *node, uint8_t always) {
+    uint32_t now = artnet_misc_time_ms();
+    artnet_controller_t *c;
+    uint8_t i, count = 0, broadcast = 0;
+    int rtn = ARTNET_EOK, ret;
+
+    for (i = 0; i < ARTNET_MAX_CONTROLLERS; i++) {
+        c = &node->controllers[i];
+        if (c->ip == 0)
+            continue;
+        if (now - c->last_poll > ARTNET_CONTROLLER_TIMEOUT_MS) {
+            c->ip = 0;
+            continue;
+        }
+        count++;
+        broadcast |= c->broadcast;
+    }
+
+    if (broadcast || (count == 0 && always)) {
+        node->reply_addr = node->bcast_addr;
+        return LAN_send_poll_reply(node, 0);
+    }
+
+    for (i = 0; i < ARTNET_MAX_CONTROLLERS && count > 0; i++) {
+        c = &node->controllers[i];
+        if (c->ip == 0)
+            continue;
+        node->reply_addr.s_addr = c->ip;
+        if ((ret = LAN_send_poll_reply(node, 0)) != ARTNET_EOK)
+            rtn = ret;
+    }
+    return rtn;
 }
 
+/*
+ * Tell the controllers about the node: the subscribed ones, or the whole
+ * network if there are none yet.
+ */
 void LAN_announce(artnet_node_t *node) {
-    node->reply_addr = node->bcast_addr;
-    LAN_send_poll_reply(node, 0);
+    node->reply_changed = 0;
+    notify(node, 1);
+}
+
+/*
+ * Bound the work done by one LAN_read call, so that a flood of packets
+ * can't starve the rest of the firmware. 0 disables a limit.
+ */
+void LAN_set_rx_budget(artnet_node_t *node, uint16_t max_packets, uint32_t max_us) {
+    node->rx_max_packets = max_packets;
+    node->rx_max_us = max_us;
+}
+
+/*
+ * Overload mode: LAN_read_batch scans each batch first and drops the
+ * ArtDmx superseded by a newer frame of the same universe, so a node
+ * which fell behind catches up in one step. Only pays off with batches
+ * of several slots.
+ */
+void LAN_set_rx_coalesce(artnet_node_t *node, uint8_t enable) {
+    node->rx_coalesce = enable != 0;
+}
+
+/*
+ * Copy the node counters, with the sequence counters of every port
+ * added up.
+ */
+void LAN_get_stats(artnet_node_t *node, artnet_stats_t *stats) {
+    uint8_t port;
+
+    memcpy(stats, &node->stats, sizeof(*stats));
+    for (port = 0; port < ARTNET_MAX_NODE_PORTS; port++) {
+        stats->dmx_accepted += node->seq[port].accepted;
+        stats->dmx_stale += node->seq[port].stale;
+        stats->dmx_gaps += node->seq[port].gaps;
+    }
+}
+
+#ifdef ARTNET_FEATURE_TOD
+/*
+ * Hand ArtTodRequest and ArtTodControl to the application, which owns
+ * the table of devices and answers with ArtTodData.
+ */
+void LAN_set_tod_callback(artnet_node_t *node, artnet_packet_callback_t cb) {
+    node->tod_callback = cb;
+}
+#endif
+
+#ifdef ARTNET_FEATURE_RDM
+void LAN_set_rdm_callback(artnet_node_t *node, artnet_packet_callback_t cb) {
+    node->rdm_callback = cb;
+}
+#endif
+
+#ifdef ARTNET_FEATURE_FIRMWARE
+/*
+ * Hand ArtFirmwareMaster blocks to the application, which writes them
+ * and answers with ArtFirmwareReply.
+ */
+void LAN_set_firmware_callback(artnet_node_t *node, artnet_packet_callback_t cb) {
+    node->firmware_callback = cb;
+}
+#endif
+
+/*
+ * Answer ArtPolls after a random delay of up to max_ms, as the spec
+ * asks, so that all the nodes don't reply at once. 0 replies right from
+ * the receive loop.
+ */
+void LAN_set_reply_delay(artnet_node_t *node, uint16_t max_ms) {
+    node->reply_max_delay = max_ms;
 }
 
 void LAN_set_name(artnet_node_t *node, const char *short_name, const char *long_name) {
     memcpy(node->short_name, short_name, ARTNET_SHORT_NAME_LENGTH);
     memcpy(node->long_name, long_name, ARTNET_LONG_NAME_LENGTH);
+    LAN_invalidate_reply(node);
 }
 
 void LAN_set_esta(artnet_node_t *node, const char esta_lo, const char esta_hi) {
     node->esta_lo = esta_lo;
     node->esta_hi = esta_hi;
+    LAN_invalidate_reply(node);
 }
 
 void LAN_set_oem(artnet_node_t *node, const uint8_t oem_lo, const uint8_t oem_hi) {
     node->oem_lo = oem_lo;
     node->oem_hi = oem_hi;
+    LAN_invalidate_reply(node);
+}
+
+void LAN_set_status(artnet_node_t *node, node_status_t status) {
+    node->status = status;
+    LAN_invalidate_reply(node);
 }
 
+/*
+ * State the front panel indicators should show, last set by an
+ * ArtAddress command.
+ */
+artnet_indicator_t LAN_get_indicator(artnet_node_t *node) {
+    return (artnet_indicator_t) node->indicator;
+}
+
+void LAN_set_report_code(artnet_node_t *node, artnet_node_report_code code) {
+    if (node->report_code == code)
+        return;
+    node->report_code = code;
+    LAN_invalidate_reply(node);
+}
+
+/*
+ * Keep track of the controllers asking for ArtPollReplies on change,
+ * TalkToMe bit 1. When the list is full, newcomers only get answers to
+ * their own ArtPolls.
+ */
+static void subscribe(artnet_node_t *node, in_addr from, uint8_t ttm) {
+    uint32_t now = artnet_misc_time_ms();
+    artnet_controller_t *c, *slot = NULL;
+    uint8_t i;
+
+    for (i = 0; i < ARTNET_MAX_CONTROLLERS; i++) {
+        c = &node->controllers[i];
+        if (c->ip == from.s_addr) {
+            slot = c;
+            break;
+        }
+        if (slot == NULL && (c->ip == 0 || now - c->last_poll > ARTNET_CONTROLLER_TIMEOUT_MS))
+            slot = c;
+    }
+
+    if (!(ttm & TTM_BEHAVIOUR_MASK)) {
+        if (slot != NULL && slot->ip == from.s_addr)
+            slot->ip = 0;
+        return;
+    }
+    if (slot == NULL)
+        return;
+
+    slot->ip = from.s_addr;
+    slot->last_poll = now;
+    slot->broadcast = (ttm & TTM_REPLY_MASK) != 0;
+}
+
+/*
+ * Schedule a reply to an ArtPoll, LAN_tick sends it. It goes to the
+ * poller unless TalkToMe asks for a broadcast.
+ */
 void LAN_handle_poll(artnet_node_t *node, artnet_packet_t *p) {
-    node->reply_addr = p->from;
-    LAN_send_poll_reply(node, 1);
+    in_addr to = (p->data.ap.ttm & TTM_REPLY_MASK) ? node->bcast_addr : p->from;
+    uint32_t r;
+
+    subscribe(node, p->from, p->data.ap.ttm);
+
+    if (node->reply_max_delay == 0) {
+        node->reply_addr = to;
+        LAN_send_poll_reply(node, 1);
+        return;
+    }
+
+    if (node->reply_pending) {
+        // several controllers are waiting, a single broadcast serves them all
+        if (node->reply_to.s_addr != to.s_addr)
+            node->reply_to = node->bcast_addr;
+        return;
+    }
+
+    r = node->rand_state ? node->rand_state : 0x2545F491;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    node->rand_state = r;
+
+    node->reply_to = to;
+    node->reply_due = artnet_misc_time_ms() + r % (node->reply_max_delay + 1);
+    node->reply_pending = 1;
 }
 
-void LAN_handle_dmx(artnet_node_t *node, artnet_packet_t *p) {
-    uint8_t dmx_data[LAN_DMX_FOOTPRINT];
-    uint16_t port;
-    memcpy(&dmx_data, p->data.admx.data + node->dmx_start, node->dmx_footprint);
-    if (node->dmx_callback != NULL)
-        node->dmx_callback(port, dmx_data);
+/*
+ * Do the deferred work of the node, never blocks.
+ * LAN_read calls it once per call, call it as well if reading is done
+ * some other way.
+ */
+int LAN_tick(artnet_node_t *node) {
+    int rtn = ARTNET_EOK, ret;
+
+    if (node->reply_pending && (int32_t) (artnet_misc_time_ms() - node->reply_due) >= 0) {
+        node->reply_pending = 0;
+        node->reply_addr = node->reply_to;
+        rtn = LAN_send_poll_reply(node, 1);
+    }
+
+    LAN_sync_tick(node);
+    LAN_loss_tick(node);
+
+    // subscribed controllers hear about changes once per tick at most
+    if (node->reply_changed) {
+        node->reply_changed = 0;
+        ret = notify(node, 0);
+        if (rtn == ARTNET_EOK)
+            rtn = ret;
+    }
+
+#ifdef ARTNET_FEATURE_INPUT
+    if (node->tx_head != NULL)
+        LAN_tx_tick(node);
+#endif
+
+    return rtn;
 }
@@ -21,18 +21,23 @@
 #ifndef LAN_H_
 #define LAN_H_
 
+#ifdef __MBED__
 #include "mbed.h"
+#else
+#include <stdio.h>
+#include <string.h>
+#endif
 
 #include <stdint.h>
 // order is important here for osx
 #include <sys/types.h>
 
+#ifdef __MBED__
 #include "UDPSocket.h"
+#endif
 
 #include "LAN_packets.h"
-
-extern UDPSocket* LAN_sock;
-extern artnet_packet_t* LAN_packet;
+#include "LAN_node.h"
 
 /**
  * An enum for setting the behaviour of a port.
@@ -60,9 +65,9 @@ typedef enum {
   ARTNET_PC_MERGE_HTP_1 = 0x51,
   ARTNET_PC_MERGE_HTP_2 = 0x52,
   ARTNET_PC_MERGE_HTP_3 = 0x53,
-  ARTNET_PC_CLR_0 = 0x93,
-  ARTNET_PC_CLR_1 = 0x93,
-  ARTNET_PC_CLR_2 = 0x93,
+  ARTNET_PC_CLR_0 = 0x90,
+  ARTNET_PC_CLR_1 = 0x91,
+  ARTNET_PC_CLR_2 = 0x92,
   ARTNET_PC_CLR_3 = 0x93,
 } artnet_port_command_t;
 
@@ -104,47 +109,139 @@ typedef enum {
 
 
 /*
- * Enum for the talk-to-me value
- * These values can be &'ed togeather, so for example to set private replies
- * and auto replying use :
- *   (ARTNET_TTM_PRIVATE & ARTNET_TTM_AUTO)
+ * Enum for the talk-to-me value of an ArtPoll
+ * These values can be or'ed together, so for example to get broadcast
+ * replies and auto replying use :
+ *   (ARTNET_TTM_BROADCAST | ARTNET_TTM_AUTO)
  */
 typedef enum {
-  ARTNET_TTM_DEFAULT = 0xFF,  /**< default, ArtPollReplies are broadcast, and nodes won't send a ArtPollReply when conditions change */
-  ARTNET_TTM_PRIVATE = 0xFE,  /**< ArtPollReplies aren't broadcast */
-  ARTNET_TTM_AUTO = 0xFD    /**< ArtPollReplies are send when node conditions chang */
+  ARTNET_TTM_DEFAULT = 0x00,    /**< default, ArtPollReplies are unicast to the poller, and nodes won't send a ArtPollReply when conditions change */
+  ARTNET_TTM_PRIVATE = ARTNET_TTM_DEFAULT, /**< deprecated, replies are private unless ARTNET_TTM_BROADCAST is set */
+  ARTNET_TTM_BROADCAST = 0x01,  /**< ArtPollReplies are broadcast */
+  ARTNET_TTM_AUTO = 0x02        /**< ArtPollReplies are sent when node conditions change */
 } artnet_ttm_value_t;
 
 // functions
 
 // LAN_transmit.cpp
 extern int LAN_send_poll_reply(artnet_node_t *node, int response);
-extern void LAN_fill_poll_reply(artnet_node_t *node, artnet_reply_t *poll_reply);
+extern void LAN_fill_poll_reply(artnet_node_t *node, uint8_t page, artnet_reply_t *poll_reply);
+extern void LAN_invalidate_reply(artnet_node_t *node);
+#ifdef ARTNET_FEATURE_INPUT
+extern int LAN_tx_add(artnet_node_t *node, artnet_tx_t *tx, uint16_t port_addr, uint16_t length);
+extern int LAN_tx_remove(artnet_node_t *node, artnet_tx_t *tx);
+extern void LAN_tx_set_dest(artnet_tx_t *tx, in_addr to);
+extern int LAN_tx_write(artnet_tx_t *tx, uint16_t offset, const uint8_t *data, uint16_t length);
+extern void LAN_set_tx_budget(artnet_node_t *node, uint16_t max_packets, uint16_t keepalive_ms);
+extern int LAN_tx_tick(artnet_node_t *node);
+#endif
 
 // LAN_network.cpp
 extern int LAN_recv(artnet_node_t *node, artnet_packet_t *p);
 extern int LAN_send(artnet_node_t *node, artnet_packet_t *packet);
+extern int LAN_sendto(artnet_node_t *node, in_addr to, const void *data, int length);
 
 // LAN.cpp
 extern int LAN_init(artnet_node_t *node);
+#ifdef __MBED__
+extern void LAN_set_socket(artnet_node_t *node, UDPSocket *sock);
+#endif
+extern void LAN_set_transport(artnet_node_t *node, artnet_transport_t *transport);
 extern void LAN_set_port(artnet_node_t *node, uint8_t subnet_hi, uint8_t subnet_lo);
-extern void LAN_set_dmx(artnet_node_t *node, uint8_t dstart, uint8_t dfootprint);
+extern int LAN_set_page(artnet_node_t *node, uint8_t page, uint8_t net, uint8_t subnet);
+extern void LAN_set_dmx(artnet_node_t *node, uint16_t dstart, uint16_t dfootprint);
 extern void LAN_set_dmx_callback(artnet_node_t *node, void (*cb)(uint16_t port, uint8_t *dmx));
+extern int LAN_set_port_dmx_callback(artnet_node_t *node, uint8_t port, void (*cb)(uint16_t port, uint8_t *dmx));
+extern int LAN_set_dmx_view_callback(artnet_node_t *node, uint8_t port, artnet_dmx_view_callback_t cb);
+extern int LAN_set_port_universe(artnet_node_t *node, uint8_t port, uint8_t universe);
+extern int LAN_clear_port(artnet_node_t *node, uint8_t port);
 extern void LAN_set_network(
         artnet_node_t *node, in_addr ip,
         in_addr bcast, in_addr gateway, in_addr netmask, uint8_t *mac_addr);
 extern void LAN_announce(artnet_node_t *node);
+extern void LAN_set_reply_delay(artnet_node_t *node, uint16_t max_ms);
+extern int LAN_tick(artnet_node_t *node);
+extern void LAN_set_rx_budget(artnet_node_t *node, uint16_t max_packets, uint32_t max_us);
+extern void LAN_set_rx_coalesce(artnet_node_t *node, uint8_t enable);
+extern void LAN_get_stats(artnet_node_t *node, artnet_stats_t *stats);
+#ifdef ARTNET_FEATURE_TOD
+extern void LAN_set_tod_callback(artnet_node_t *node, artnet_packet_callback_t cb);
+#endif
+#ifdef ARTNET_FEATURE_RDM
+extern void LAN_set_rdm_callback(artnet_node_t *node, artnet_packet_callback_t cb);
+#endif
+#ifdef ARTNET_FEATURE_FIRMWARE
+extern void LAN_set_firmware_callback(artnet_node_t *node, artnet_packet_callback_t cb);
+#endif
 extern void LAN_set_name(artnet_node_t *node, const char *short_name, const char *long_name);
 extern void LAN_set_esta(artnet_node_t *node, const char esta_lo, const char esta_hi);
 extern void LAN_set_oem(artnet_node_t *node, const uint8_t oem_lo, const uint8_t oem_hi);
+extern void LAN_set_status(artnet_node_t *node, node_status_t status);
+extern artnet_indicator_t LAN_get_indicator(artnet_node_t *node);
+extern void LAN_set_report_code(artnet_node_t *node, artnet_node_report_code code);
 extern void LAN_handle_poll(artnet_node_t *node, artnet_packet_t *p);
+
+// LAN_merge.cpp
+extern int LAN_set_port_merge(artnet_node_t *node, uint8_t port, artnet_merge_t *merge, artnet_merge_mode_t mode);
+extern int LAN_set_merge_mode(artnet_node_t *node, uint8_t port, artnet_merge_mode_t mode);
+extern int LAN_merge_frame(artnet_node_t *node, uint8_t port, in_addr from, artnet_dmx_view_t *view);
+extern int LAN_cancel_merge(artnet_node_t *node, uint8_t port);
+extern void LAN_merge_htp(uint8_t *out, const uint8_t *a, const uint8_t *b, uint16_t length);
+
+// LAN_address.cpp
+extern void LAN_handle_address(artnet_node_t *node, artnet_packet_t *p);
+extern uint8_t LAN_persist_poll(artnet_node_t *node);
+
+// LAN_patch.cpp
+extern int LAN_patch_compile(artnet_patch_t *patch, artnet_patch_op_t *ops, uint16_t max_ops,
+        const artnet_fixture_t *fixtures, uint16_t nfixtures);
+extern void LAN_patch_apply(const artnet_patch_t *patch, const artnet_dmx_view_t *view);
+extern void LAN_set_patch(artnet_node_t *node, artnet_patch_t *patch);
+
+// LAN_interp.cpp
+extern void LAN_interp_init(artnet_interp_t *interp, uint16_t max_ticks);
+extern int LAN_interp_set_mode(artnet_interp_t *interp, uint16_t first, uint16_t count, artnet_interp_mode_t mode);
+extern void LAN_interp_stage(artnet_interp_t *interp, const artnet_dmx_view_t *view);
+extern uint16_t LAN_interp_tick(artnet_interp_t *interp, uint8_t *out);
+extern int LAN_set_port_interp(artnet_node_t *node, uint8_t port, artnet_interp_t *interp);
+
+// LAN_loss.cpp
+extern int LAN_set_port_loss(artnet_node_t *node, uint8_t port, artnet_loss_policy_t policy,
+        uint16_t timeout_ms, uint16_t fade_ms, uint8_t *buffer);
+extern void LAN_set_loss_callback(artnet_node_t *node, void (*cb)(uint16_t port, uint8_t lost));
+extern void LAN_loss_seen(artnet_node_t *node, uint8_t port, const artnet_dmx_view_t *view, uint32_t now);
+extern void LAN_loss_tick(artnet_node_t *node);
+
+// LAN_queue.cpp
+extern int LAN_set_port_queue(artnet_node_t *node, uint8_t port, artnet_frame_queue_t *queue);
+extern void LAN_queue_publish(artnet_frame_queue_t *queue, const artnet_dmx_view_t *view);
+extern int LAN_queue_read(artnet_frame_queue_t *queue, artnet_dmx_view_t *view);
+
+// LAN_dmx.cpp
 extern void LAN_handle_dmx(artnet_node_t *node, artnet_packet_t *p);
+extern void LAN_handle_sync(artnet_node_t *node, artnet_packet_t *p);
+extern void LAN_sync_tick(artnet_node_t *node);
+extern void LAN_deliver_dmx(artnet_node_t *node, uint8_t port, artnet_dmx_view_t *view);
+extern int LAN_set_port_sync(artnet_node_t *node, uint8_t port, uint8_t *buffers);
+extern void LAN_update_port_map(artnet_node_t *node);
+extern int LAN_find_port(artnet_node_t *node, uint16_t port_addr);
+extern int LAN_set_change_detection(artnet_node_t *node, uint8_t port, uint8_t *last_frame);
+extern uint8_t LAN_diff_frame(uint8_t *last, uint16_t last_length,
+        const uint8_t *data, uint16_t length, artnet_dmx_range_t *ranges);
+extern int LAN_get_seq(artnet_node_t *node, uint8_t port, artnet_seq_t *seq);
 
 // LAN_receive.cpp
 extern int LAN_read(artnet_node_t *node, artnet_packet_t *p);
+extern int LAN_read_batch(artnet_node_t *node, artnet_packet_t *slots, int nslots);
 extern int LAN_handle(artnet_node_t *node, artnet_packet_t *p);
 extern int16_t LAN_get_type(artnet_packet_t *p);
 
 // void artnet_error(arnet_node *node, const char *fmt, ...);
 
+#include "LAN_pcap.h"
+
+#if !defined(__MBED__) && defined(__linux__)
+#include "LAN_posix.h"
+#endif
+
 #endif
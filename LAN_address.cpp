@@ -0,0 +1,177 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * address.c
+ * ArtAddress, remote programming of the node
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+// fields with this bit set carry a new value. We have no physical
+// switches, so "reset to switches" (0x00) leaves the setting alone too.
+#define PROGRAM_BIT (0x80)
+
+static const uint8_t zero_frame[ARTNET_DMX_LENGTH] = { 0 };
+
+static uint8_t set_name(char *name, const uint8_t *value, uint8_t size) {
+    // an empty name means no change
+    if (value[0] == '\0' || strncmp(name, (const char *) value, size - 1) == 0)
+        return 0;
+
+    memcpy(name, value, size - 1);
+    name[size - 1] = '\0';
+    return ARTNET_PERSIST_NAME;
+}
+
+static uint8_t set_switch(uint8_t *sw, uint8_t value, uint8_t mask) {
+    if (!(value & PROGRAM_BIT) || *sw == (value & mask))
+        return 0;
+
+    *sw = value & mask;
+    return ARTNET_PERSIST_ADDRESS;
+}
+
+/*
+ * Blackout an output port: output an all zero frame and forget the
+ * frames waiting for an ArtSync or merged in.
+ */
+static void clear_port(artnet_node_t *node, uint8_t port) {
+    artnet_merge_t *m = node->merge[port];
+    artnet_dmx_view_t view;
+    uint8_t i;
+
+    node->sync[port].pending = 0;
+    if (m != NULL) {
+        for (i = 0; i < ARTNET_MERGE_SOURCES; i++)
+            m->src[i].ip = 0;
+    }
+
+    if (!(node->ports.types[port] & ARTNET_ENABLE_OUTPUT))
+        return;
+
+    view.data = zero_frame;
+    view.length = node->last_length[port];
+    if (view.length == 0)
+        view.length = ARTNET_DMX_LENGTH;
+    view.universe = node->port_addr[port];
+    view.sequence = 0;
+    view.port = port;
+    LAN_deliver_dmx(node, port, &view);
+}
+
+/*
+ * Run the command of an ArtAddress, on the ports of its page.
+ * Returns the ARTNET_PERSIST_* flags of what it changed.
+ */
+static uint8_t port_command(artnet_node_t *node, uint8_t first, uint8_t command) {
+    uint8_t port;
+
+    if (command == ARTNET_PC_CANCEL) {
+        for (port = first; port < first + ARTNET_MAX_PORTS; port++)
+            LAN_cancel_merge(node, port);
+
+    } else if (command >= ARTNET_PC_LED_NORMAL && command <= ARTNET_PC_LED_LOCATE) {
+        node->indicator = command == ARTNET_PC_LED_NORMAL ? ARTNET_INDICATOR_NORMAL :
+                          command == ARTNET_PC_LED_MUTE ? ARTNET_INDICATOR_MUTE : ARTNET_INDICATOR_LOCATE;
+        LAN_invalidate_reply(node);
+
+    } else if (command == ARTNET_PC_RESET) {
+        // AcResetRxFlags: only the receive and error flags, merge and sync stay
+        for (port = first; port < first + ARTNET_MAX_PORTS; port++) {
+            node->ports.output[port] &= ~(PORT_STATUS_ERROR | PORT_STATUS_DMX_TEXT
+                    | PORT_STATUS_DMX_SIP | PORT_STATUS_DMX_TEST);
+        }
+        node->report_code = ARTNET_RCPOWEROK;
+        LAN_invalidate_reply(node);
+
+    } else if (command >= ARTNET_PC_MERGE_LTP_O && command <= ARTNET_PC_MERGE_LTP_3) {
+        port = first + command - ARTNET_PC_MERGE_LTP_O;
+        if (node->merge[port] != NULL && node->merge[port]->mode != ARTNET_MERGE_LTP) {
+            LAN_set_merge_mode(node, port, ARTNET_MERGE_LTP);
+            return ARTNET_PERSIST_MERGE;
+        }
+
+    } else if (command >= ARTNET_PC_MERGE_HTP_0 && command <= ARTNET_PC_MERGE_HTP_3) {
+        port = first + command - ARTNET_PC_MERGE_HTP_0;
+        if (node->merge[port] != NULL && node->merge[port]->mode != ARTNET_MERGE_HTP) {
+            LAN_set_merge_mode(node, port, ARTNET_MERGE_HTP);
+            return ARTNET_PERSIST_MERGE;
+        }
+
+    } else if (command >= ARTNET_PC_CLR_0 && command <= ARTNET_PC_CLR_3) {
+        clear_port(node, first + command - ARTNET_PC_CLR_0);
+    }
+
+    return 0;
+}
+
+/*
+ * ArtAddress: apply what it programs right away and answer with an
+ * ArtPollReply. The bind index picks the page of ports (0 and 1 are
+ * both the first one). Saving the new settings is left to the
+ * application, see LAN_persist_poll.
+ */
+void LAN_handle_address(artnet_node_t *node, artnet_packet_t *p) {
+    artnet_address_t *addr = &p->data.addr;
+    uint8_t page = addr->bindindex > 0 ? addr->bindindex - 1 : 0;
+    uint8_t first = page * ARTNET_MAX_PORTS;
+    uint8_t changed = 0;
+    uint8_t i;
+
+    if (page >= ARTNET_MAX_PAGES)
+        return;
+
+    changed |= set_name(node->short_name, addr->shortname, ARTNET_SHORT_NAME_LENGTH);
+    changed |= set_name(node->long_name, addr->longname, ARTNET_LONG_NAME_LENGTH);
+
+    changed |= set_switch(&node->subnet_hi[page], addr->netswitch, 0x7F);
+    changed |= set_switch(&node->subnet_lo[page], addr->subnet, 0x0F);
+    for (i = 0; i < ARTNET_MAX_PORTS; i++) {
+        changed |= set_switch(&node->swin[first + i], addr->swin[i], 0x0F);
+        changed |= set_switch(&node->swout[first + i], addr->swout[i], 0x0F);
+    }
+
+    changed |= port_command(node, first, addr->command);
+
+    if (changed & ARTNET_PERSIST_ADDRESS)
+        LAN_update_port_map(node);
+
+    if (changed) {
+        node->persist_dirty |= changed;
+        node->persist_due = artnet_misc_time_ms() + ARTNET_PERSIST_SETTLE_MS;
+        LAN_invalidate_reply(node);
+    }
+
+    node->reply_addr = p->from;
+    LAN_send_poll_reply(node, 1);
+}
+
+/*
+ * Settings changed by ArtAddress which should be saved, as
+ * ARTNET_PERSIST_* flags. They are returned once, when no ArtAddress
+ * touched them for ARTNET_PERSIST_SETTLE_MS; call it from the main
+ * loop and write flash there, not from a callback.
+ */
+uint8_t LAN_persist_poll(artnet_node_t *node) {
+    uint8_t dirty = node->persist_dirty;
+
+    if (dirty == 0 || (int32_t) (artnet_misc_time_ms() - node->persist_due) < 0)
+        return 0;
+
+    node->persist_dirty = 0;
+    return dirty;
+}
@@ -21,6 +21,8 @@
 #ifndef LAN_COMMON_H_
 #define LAN_COMMON_H_
 
+#include "LAN_config.h"
+
 /*
  * libartnet error codes
  */
@@ -31,6 +33,7 @@ enum {
   ARTNET_EARG = -3, // argument error
   ARTNET_ESTATE = -4, // state error
   ARTNET_EACTION = -5, // invalid action
+  ARTNET_ENODATA = -6, // nothing left to read
 };
 
 
@@ -63,6 +66,34 @@ extern uint8_t MIN_PACKET_SIZE;
  */
 enum { ARTNET_MAX_PORTS = 4 };
 
+/*
+ * A node with more ports shows them as pages of ARTNET_MAX_PORTS, each
+ * with its own bind index and ArtPollReply (Art-Net 4). Define it in
+ * config.h, up to 16 pages (64 universes).
+ */
+#ifndef ARTNET_MAX_PAGES
+#define ARTNET_MAX_PAGES 1
+#endif
+
+enum { ARTNET_MAX_NODE_PORTS = ARTNET_MAX_PORTS * ARTNET_MAX_PAGES };
+
+/*
+ * Size of the Port-Address lookup table. Must be a power of two and
+ * at least twice ARTNET_MAX_NODE_PORTS so that misses stay short.
+ */
+enum {
+  ARTNET_PORT_HASH_SIZE = ARTNET_MAX_NODE_PORTS <= 4 ? 16
+      : ARTNET_MAX_NODE_PORTS <= 8 ? 32
+      : ARTNET_MAX_NODE_PORTS <= 16 ? 64
+      : ARTNET_MAX_NODE_PORTS <= 32 ? 128 : 256
+};
+
+/*
+ * A 15 bit Port-Address is made of net (7 bits), subnet (4 bits) and
+ * universe (4 bits).
+ */
+enum { ARTNET_PORT_ADDRESS_MASK = 0x7FFF };
+
 /**
  * The length of the short name field. Always 18
  */
@@ -88,6 +119,26 @@ enum { ARTNET_DMX_LENGTH = 512 };
  */
 enum { ARTNET_RDM_UID_WIDTH = 6 };
 
+/*
+ * Most UIDs in an ArtTodData
+ */
+enum { ARTNET_MAX_UID_COUNT = 200 };
+
+/*
+ * Most Port-Addresses in an ArtTodRequest
+ */
+enum { ARTNET_MAX_RDM_ADCOUNT = 32 };
+
+/*
+ * Length of the RDM packet in an ArtRdm, without its start code
+ */
+enum { ARTNET_MAX_RDM_DATA = 512 };
+
+/*
+ * Length in 16 bit words of an ArtFirmwareMaster block
+ */
+enum { ARTNET_FIRMWARE_SIZE = 512 };
+
 /*
  * Length of the hardware address
  */
@@ -105,6 +156,73 @@ enum { ARTNET_IP_SIZE = 4 };
 
 #define LAN_DMX_FOOTPRINT   (10)
 
+/*
+ * Number of sources merged on a port, the spec only allows two
+ */
+enum { ARTNET_MERGE_SOURCES = 2 };
+
+/*
+ * Most changed slot ranges reported with a frame, further changes are
+ * folded in the last range
+ */
+enum { ARTNET_MAX_DIRTY_RANGES = 8 };
+
+/*
+ * Changes closer than this are reported as a single range
+ */
+enum { ARTNET_DIRTY_GAP = 4 };
+
+/*
+ * A frame this much behind the last one is stale, further behind the
+ * sender is assumed to have restarted
+ */
+enum { ARTNET_SEQ_WINDOW = 32 };
+
+/*
+ * Without an ArtSync for this long, the node goes back to outputting
+ * each universe as it arrives
+ */
+enum { ARTNET_SYNC_TIMEOUT_MS = 4000 };
+
+/*
+ * Unchanged universes are still sent this often, well within the
+ * spec's 4 s data loss timeout
+ */
+enum { ARTNET_TX_KEEPALIVE_MS = 1000 };
+
+/*
+ * Upper bound of the random delay before answering an ArtPoll
+ */
+enum { ARTNET_REPLY_DELAY_MS = 1000 };
+
+/*
+ * A source which didn't send for this long is dropped from the merge
+ */
+enum { ARTNET_MERGE_TIMEOUT_MS = 10000 };
+
+/*
+ * Controllers which asked for ArtPollReplies on change, and how long
+ * they stay subscribed without polling again
+ */
+enum { ARTNET_MAX_CONTROLLERS = 8 };
+enum { ARTNET_CONTROLLER_TIMEOUT_MS = 10000 };
+
+/*
+ * Settings changed over the network are handed out for saving once
+ * they have been left alone this long, so that a console programming
+ * many fields or nodes in a row costs a single flash write
+ */
+enum { ARTNET_PERSIST_SETTLE_MS = 2000 };
+
+/*
+ * What LAN_persist_poll reports as changed
+ */
+enum {
+  ARTNET_PERSIST_NAME = 0x01,     // short and long name
+  ARTNET_PERSIST_ADDRESS = 0x02,  // net, subnet, swin and swout
+  ARTNET_PERSIST_MERGE = 0x04,    // merge mode of the ports
+};
+
 
 // the node report codes
 typedef enum {
@@ -149,44 +267,299 @@ typedef enum {
   ARTNET_ON
 } node_status_t;
 
+// front panel indicators, as set by ArtAddress (bits 7-6 of Status1)
+typedef enum {
+  ARTNET_INDICATOR_UNKNOWN = 0x00,
+  ARTNET_INDICATOR_LOCATE = 0x40,
+  ARTNET_INDICATOR_MUTE = 0x80,
+  ARTNET_INDICATOR_NORMAL = 0xC0
+} artnet_indicator_t;
+
+// a run of slots, 0 based
+typedef struct {
+  uint16_t start;
+  uint16_t length;
+} artnet_dmx_range_t;
+
+/**
+ * A received universe, handed to the application without copying.
+ * data points into the receive buffer and is only valid during the
+ * callback.
+ */
+typedef struct {
+  const uint8_t *data;  // slot 1 of the universe
+  uint16_t length;      // number of slots in data
+  uint16_t universe;    // 15 bit Port-Address
+  uint8_t sequence;     // ArtDmx sequence, 0 if disabled by the sender
+  uint8_t port;         // output port the universe is patched to
+  const artnet_dmx_range_t *dirty;  // slots changed since the last frame,
+  uint8_t ndirty;                   // NULL/0 without change detection
+} artnet_dmx_view_t;
+
+typedef void (*artnet_dmx_view_callback_t)(const artnet_dmx_view_t *dmx);
+
+// how the sources of a port are combined
+typedef enum {
+  ARTNET_MERGE_HTP,   // highest takes precedence, the default
+  ARTNET_MERGE_LTP    // latest takes precedence, slot by slot
+} artnet_merge_mode_t;
+
 /**
- * The main node structure
- */
-typedef struct artnet_node_s{
-  uint8_t id[8];
-  uint8_t mac_addr[ARTNET_MAC_SIZE];
-  in_addr reply_addr;
-  in_addr ip_addr;
-  in_addr bcast_addr;
-  in_addr gateway_addr;
-  in_addr subnet_mask;
-  char short_name[ARTNET_SHORT_NAME_LENGTH];
-  char long_name[ARTNET_LONG_NAME_LENGTH];
-  char report[ARTNET_REPORT_LENGTH];
-  node_status_t status;
-  struct ports_s {
-    uint8_t  types[ARTNET_MAX_PORTS];    // type of port
-    uint8_t output[ARTNET_MAX_PORTS]; // output ports
-    uint8_t input[ARTNET_MAX_PORTS]; // input ports
-  } ports;
-  uint8_t subnet_hi;
-  uint8_t subnet_lo;
-  uint8_t oem_hi;
-  uint8_t oem_lo;
-  uint8_t esta_hi;
-  uint8_t esta_lo;
-  uint8_t fmw_hi;
-  uint8_t fmw_lo;
-  uint8_t ubea;
-  uint8_t swin[ARTNET_MAX_PORTS];
-  uint8_t swout[ARTNET_MAX_PORTS];
-  uint8_t swvideo;
-  uint8_t swmacro;
-  uint8_t swremote;
-  artnet_node_report_code report_code;
-  void (*dmx_callback)(uint16_t portid, uint8_t *dmx);
-  uint8_t dmx_start;
-  uint8_t dmx_footprint;
-} artnet_node_t;
+ * Merge state of one output port. It's big (about 1.5k) so the
+ * application provides it, only for the ports which need merging.
+ */
+typedef struct {
+  struct {
+    in_addr_t ip;         // 0 if the slot is free
+    uint32_t last_seen;   // ms, see artnet_misc_time_ms
+    uint16_t length;
+    uint8_t data[ARTNET_DMX_LENGTH];
+  } src[ARTNET_MERGE_SOURCES];
+  uint8_t out[ARTNET_DMX_LENGTH];  // HTP result, or the LTP state
+  uint8_t mode;           // artnet_merge_mode_t
+  uint8_t cancel;         // keep only the source of the next frame
+} artnet_merge_t;
+
+/**
+ * Double buffer of an output port for synchronous mode. The buffers
+ * are provided by the application.
+ */
+typedef struct {
+  uint8_t *buf[2];        // buf[front] is output, the other one fills up
+  uint16_t length[2];
+  uint8_t sequence[2];
+  uint8_t front;
+  uint8_t pending;        // back buffer holds a frame waiting for ArtSync
+} artnet_sync_buffer_t;
+
+/**
+ * Hand-off of the frames of a port to another thread or an ISR, without
+ * locks. A triple buffer: the network side fills one slot, the output
+ * side reads another, the third is exchanged between them. The reader
+ * always gets the newest complete frame, older ones are overwritten.
+ */
+typedef struct {
+  uint8_t data[3][ARTNET_DMX_LENGTH];
+  uint16_t length[3];
+  uint8_t sequence[3];
+  uint16_t universe[3];   // Port-Address the frame came in on
+  uint8_t port;
+  uint8_t back;           // written by the network side only
+  uint8_t front;          // read by the output side only
+  volatile uint8_t middle;  // slot being exchanged | ARTNET_QUEUE_FRESH
+} artnet_frame_queue_t;
+
+/*
+ * artnet_channel_t.fine of 8 bit parameters
+ */
+enum { ARTNET_CHANNEL_8BIT = 0xFF };
+
+/**
+ * One parameter of a fixture: where it is in the fixture's slots and
+ * where it goes in the application's parameter struct. 16 bit ones are
+ * stored as uint16_t (coarse << 8 | fine), 8 bit ones as uint8_t.
+ */
+typedef struct {
+  uint8_t coarse;         // slot from the fixture start
+  uint8_t fine;           // slot of the fine byte, ARTNET_CHANNEL_8BIT if none
+  uint16_t offset;        // offsetof() the field in the parameter struct
+} artnet_channel_t;
+
+/**
+ * A fixture declared to the patch engine
+ */
+typedef struct {
+  uint16_t universe;                  // 15 bit Port-Address
+  uint16_t start;                     // first slot, from 0
+  const artnet_channel_t *channels;   // layout, usually shared by fixtures of a type
+  uint8_t nchannels;
+  void *params;                       // parameter struct filled from each frame
+} artnet_fixture_t;
+
+/**
+ * A compiled parameter: copy slot coarse (and fine) of the frame to dst
+ */
+typedef struct {
+  uint8_t *dst;
+  uint16_t coarse;
+  uint16_t fine;          // ARTNET_PATCH_8BIT for 8 bit parameters
+} artnet_patch_op_t;
+
+enum { ARTNET_PATCH_8BIT = 0xFFFF };
+
+/**
+ * Fixtures compiled by LAN_patch_compile into one gather table per
+ * universe, ordered by slot. ops is provided by the application.
+ */
+typedef struct {
+  artnet_patch_op_t *ops;
+  uint16_t max_ops;
+  struct {
+    uint16_t universe;
+    uint16_t first;       // index in ops
+    uint16_t count;
+  } universes[ARTNET_MAX_NODE_PORTS];   // sorted by universe
+  uint8_t nuniverses;
+} artnet_patch_t;
+
+typedef enum {
+  ARTNET_INTERP_SNAP,     // output each frame as it comes
+  ARTNET_INTERP_LINEAR,   // ramp from the previous frame over a frame interval
+} artnet_interp_mode_t;
+
+/*
+ * Weight of a new sample in the frame interval average, 1 / 2^shift
+ */
+enum { ARTNET_INTERP_EWMA_SHIFT = 3 };
+
+/*
+ * Longest ramp, the frame interval is kept as ticks << 4 in 16 bits
+ */
+enum { ARTNET_INTERP_MAX_TICKS = 4095 };
+
+/**
+ * Upsampling of the frames of a port to the output rate. The network
+ * side stages frames (a seqlock guards them), the output side ramps its
+ * 8.8 fixed point values towards the staged frame on each tick, over
+ * the average frame interval. About 3k, provided by the application.
+ */
+typedef struct {
+  // network side
+  uint8_t staged[ARTNET_DMX_LENGTH];
+  uint16_t staged_length;
+  volatile uint8_t seq;   // odd while staged is being written
+  // output side
+  uint8_t applied;        // seq of the frame being ramped to
+  uint16_t length;
+  uint16_t remaining;     // ticks left in the ramp
+  uint16_t since;         // ticks since the last frame
+  uint16_t interval;      // average frame interval, ticks << 4
+  uint16_t max_ticks;     // longest ramp, a pause in the stream isn't a slow frame
+  uint8_t target[ARTNET_DMX_LENGTH];
+  uint16_t value[ARTNET_DMX_LENGTH];  // 8.8 fixed point
+  int16_t step[ARTNET_DMX_LENGTH];    // added to value each tick
+  uint32_t linear[ARTNET_DMX_LENGTH / 32];  // channel mode, bit set for linear
+} artnet_interp_t;
+
+/**
+ * A controller subscribed to changes, TalkToMe bit 1
+ */
+typedef struct {
+  in_addr_t ip;         // 0 if the slot is free
+  uint32_t last_poll;   // ms
+  uint8_t broadcast;    // TalkToMe bit 0, wants broadcast replies
+} artnet_controller_t;
+
+typedef enum {
+  ARTNET_LOSS_HOLD,       // keep the last look
+  ARTNET_LOSS_FADE,       // fade the last look to zero
+  ARTNET_LOSS_SCENE,      // output a preset scene
+} artnet_loss_policy_t;
+
+/*
+ * A port which received nothing for this long has lost its data, the
+ * spec's data loss timeout
+ */
+enum { ARTNET_LOSS_TIMEOUT_MS = 4000 };
+
+/*
+ * Timer wheel of the data loss timeouts: slot width and number of slots.
+ * Longer timeouts go around the wheel several times.
+ */
+enum { ARTNET_LOSS_TICK_MS = 128 };
+enum { ARTNET_LOSS_WHEEL_SLOTS = 32 };
+
+/*
+ * Interval between two frames of a fade
+ */
+enum { ARTNET_LOSS_FADE_STEP_MS = 40 };
+
+enum {
+  ARTNET_LOSS_IDLE,       // no frame yet, or the policy was just set
+  ARTNET_LOSS_ARMED,      // receiving, a timeout is pending
+  ARTNET_LOSS_LOST,       // timed out, the policy has been applied
+};
+
+/**
+ * Data loss state of a port
+ */
+typedef struct {
+  uint32_t last_seen;     // ms, last frame
+  uint32_t lost_at;       // ms, start of the fade
+  uint32_t last_step;     // ms, last frame of the fade
+  uint16_t timeout;       // ms, 0 to never time out
+  uint16_t fade;          // ms, for ARTNET_LOSS_FADE
+  uint8_t *look;          // last frame, application owned, for ARTNET_LOSS_FADE
+  const uint8_t *scene;   // application owned, for ARTNET_LOSS_SCENE
+  uint16_t length;        // of look
+  uint8_t policy;         // artnet_loss_policy_t
+  uint8_t state;
+  uint8_t in_wheel;
+  uint8_t wheel_next;     // next port (+1) in the same wheel slot
+  uint8_t fade_next;      // next port (+1) fading
+} artnet_loss_t;
+
+enum { ARTNET_QUEUE_FRESH = 0x80 };
+
+/**
+ * Sequence tracking of an output port, per source
+ */
+typedef struct {
+  in_addr_t ip[ARTNET_MERGE_SOURCES];
+  uint8_t last[ARTNET_MERGE_SOURCES];   // last accepted sequence, 0 if none
+  uint8_t victim;                       // slot replaced by the next new source
+  uint32_t accepted;                    // frames passed on
+  uint32_t stale;                       // frames dropped as late or duplicate
+  uint32_t gaps;                        // accepted frames with missing predecessors
+} artnet_seq_t;
+
+/*
+ * Received packet counters are kept per handled opcode, anything else
+ * with a valid header lands in ARTNET_STAT_OTHER
+ */
+typedef enum {
+  ARTNET_STAT_OTHER,
+  ARTNET_STAT_POLL,
+  ARTNET_STAT_ADDRESS,
+  ARTNET_STAT_DMX,
+  ARTNET_STAT_SYNC,
+#ifdef ARTNET_FEATURE_INPUT
+  ARTNET_STAT_INPUT,
+#endif
+#ifdef ARTNET_FEATURE_TOD
+  ARTNET_STAT_TODREQUEST,
+  ARTNET_STAT_TODCONTROL,
+#endif
+#ifdef ARTNET_FEATURE_RDM
+  ARTNET_STAT_RDM,
+#endif
+#ifdef ARTNET_FEATURE_FIRMWARE
+  ARTNET_STAT_FIRMWARE,
+#endif
+  ARTNET_STAT_OPCODES
+} artnet_stat_opcode_t;
+
+/**
+ * Node counters, see LAN_get_stats. They wrap around, compare
+ * snapshots by difference.
+ */
+typedef struct {
+  uint32_t rx_packets;                  // datagrams read from the transport
+  uint32_t rx_opcode[ARTNET_STAT_OPCODES];  // handled packets by opcode
+  uint32_t rx_filtered;                 // own and loopback packets
+  uint32_t rx_malformed;                // bad id, too short or bad length
+  uint32_t rx_unsubscribed;             // ArtDmx for no port of ours
+  uint32_t rx_coalesced;                // ArtDmx superseded in their batch, see LAN_set_rx_coalesce
+  uint32_t dmx_accepted;                // sequence counters of all ports
+  uint32_t dmx_stale;
+  uint32_t dmx_gaps;
+  uint32_t tx_packets;                  // datagrams sent
+  uint32_t tx_udp_fail;                 // send errors, ARTNET_RCUDPFAIL
+  uint32_t tx_short;                    // partial sends, ARTNET_RCSOCKETWR1
+  uint32_t tx_replies;                  // ArtPollReplies, shown in the node report
+  uint32_t callbacks;                   // DMX callbacks made
+  uint32_t callback_us;                 // time spent in them
+  uint32_t callback_max_us;             // longest one
+} artnet_stats_t;
 
 #endif
@@ -0,0 +1,47 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * config.h
+ * Picks up the application's config.h, which enables optional features
+ */
+
+#ifndef LAN_CONFIG_H_
+#define LAN_CONFIG_H_
+
+/*
+ * Features are off unless config.h (anywhere on the include path)
+ * defines them, see README.md:
+ *   ARTNET_FEATURE_INPUT      sending DMX, ArtInput
+ *   ARTNET_FEATURE_TOD        ArtTodRequest, ArtTodData, ArtTodControl
+ *   ARTNET_FEATURE_RDM        ArtRdm, needs ARTNET_FEATURE_TOD
+ *   ARTNET_FEATURE_FIRMWARE   ArtFirmwareMaster, ArtFirmwareReply
+ *   ARTNET_FEATURE_PCAP       capture to and replay from pcap files, needs stdio
+ * and ARTNET_MAX_PAGES sets the number of pages of 4 ports.
+ */
+#if defined(__has_include)
+#if __has_include("config.h")
+#include "config.h"
+#endif
+#endif
+
+#if defined(ARTNET_FEATURE_RDM) && !defined(ARTNET_FEATURE_TOD)
+#error "ARTNET_FEATURE_RDM needs ARTNET_FEATURE_TOD"
+#endif
+
+#if defined(ARTNET_MAX_PAGES) && (ARTNET_MAX_PAGES < 1 || ARTNET_MAX_PAGES > 16)
+#error "ARTNET_MAX_PAGES must be 1 to 16"
+#endif
+
+#endif
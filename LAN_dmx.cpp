@@ -0,0 +1,445 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * dmx.c
+ * Port-Address lookup and delivery of received ArtDmx
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+/*
+ * Spread consecutive Port-Addresses over the table, a node usually
+ * listens to a contiguous block of universes.
+ */
+static inline uint8_t port_hash(uint16_t port_addr) {
+    return (port_addr ^ (port_addr >> 7)) & (ARTNET_PORT_HASH_SIZE - 1);
+}
+
+/*
+ * Rebuild the Port-Address table from the net/subnet switches of each
+ * page and the swout of every enabled output port. Must be called each time one of
+ * them changes.
+ */
+void LAN_update_port_map(artnet_node_t *node) {
+    uint16_t addr;
+    uint8_t h, i, page, prev;
+
+    memset(node->port_hash, 0x00, sizeof(node->port_hash));
+    memset(node->port_next, 0x00, sizeof(node->port_next));
+
+    for (i = 0; i < ARTNET_MAX_NODE_PORTS; i++) {
+        page = i / ARTNET_MAX_PORTS;
+        addr = ((node->subnet_hi[page] & 0x7F) << 8)
+            | ((node->subnet_lo[page] & 0x0F) << 4)
+            | (node->swout[i] & 0x0F);
+        node->port_addr[i] = addr;
+
+        if (!(node->ports.types[i] & ARTNET_ENABLE_OUTPUT))
+            continue;
+
+        h = port_hash(addr);
+        while (node->port_hash[h] != 0) {
+            if (node->port_addr[node->port_hash[h] - 1] == addr)
+                break;
+            h = (h + 1) & (ARTNET_PORT_HASH_SIZE - 1);
+        }
+
+        if (node->port_hash[h] == 0) {
+            node->port_hash[h] = i + 1;
+            continue;
+        }
+
+        // same universe patched on several ports, chain them
+        prev = node->port_hash[h] - 1;
+        while (node->port_next[prev] != 0)
+            prev = node->port_next[prev] - 1;
+        node->port_next[prev] = i + 1;
+    }
+}
+
+/*
+ * Return the first output port patched to port_addr, or -1 if this
+ * node doesn't listen to it.
+ */
+int LAN_find_port(artnet_node_t *node, uint16_t port_addr) {
+    uint8_t h = port_hash(port_addr);
+    uint8_t slot;
+
+    while ((slot = node->port_hash[h]) != 0) {
+        if (node->port_addr[slot - 1] == port_addr)
+            return slot - 1;
+        h = (h + 1) & (ARTNET_PORT_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+/*
+ * Slot of source ip in s, or -1 if it isn't tracked yet.
+ */
+static int seq_find(const artnet_seq_t *s, in_addr_t ip) {
+    int i;
+
+    for (i = 0; i < ARTNET_MERGE_SOURCES; i++) {
+        if (s->ip[i] == ip)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * How far sequence is ahead of last, 1 for the next frame. Sequences
+ * run 1..255 then wrap to 1, 0 means the sender doesn't use them and
+ * every frame counts as the next one.
+ */
+static int seq_distance(uint8_t last, uint8_t sequence) {
+    int d;
+
+    if (sequence == 0 || last == 0)
+        return 1;
+
+    d = sequence - last;
+    if (d > 127)
+        d -= 255;
+    else if (d < -127)
+        d += 255;
+    return d;
+}
+
+/*
+ * Check a sequence number against the last one from the same source,
+ * slot as returned by seq_find. Nothing is recorded, a frame only
+ * counts once seq_accept is called.
+ * Returns true for a stale frame which must be dropped.
+ */
+static bool seq_stale(artnet_seq_t *s, int slot, uint8_t sequence) {
+    int d;
+
+    if (slot < 0)
+        return false;
+
+    d = seq_distance(s->last[slot], sequence);
+    if (d <= 0 && d > -ARTNET_SEQ_WINDOW) {
+        s->stale++;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Record a frame passed on, from a source found at slot or a new one
+ * (slot -1), which takes a free slot or the oldest one.
+ */
+static void seq_accept(artnet_seq_t *s, int slot, in_addr_t ip, uint8_t sequence) {
+    if (slot < 0) {
+        for (slot = 0; slot < ARTNET_MERGE_SOURCES && s->ip[slot] != 0; slot++)
+            ;
+        if (slot == ARTNET_MERGE_SOURCES) {
+            slot = s->victim;
+            s->victim = (s->victim + 1) % ARTNET_MERGE_SOURCES;
+        }
+        s->ip[slot] = ip;
+        s->last[slot] = 0;
+    }
+
+    if (seq_distance(s->last[slot], sequence) > 1)
+        s->gaps++;
+
+    s->last[slot] = sequence;
+    s->accepted++;
+}
+
+/*
+ * Keep the last frame of port in last_frame (ARTNET_DMX_LENGTH bytes,
+ * owned by the application) and only call back when it changes. NULL
+ * turns change detection off.
+ */
+int LAN_set_change_detection(artnet_node_t *node, uint8_t port, uint8_t *last_frame) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    if (last_frame != NULL)
+        memset(last_frame, 0x00, ARTNET_DMX_LENGTH);
+    node->last_frame[port] = last_frame;
+    node->last_length[port] = 0;
+    return ARTNET_EOK;
+}
+
+static uint8_t add_range(artnet_dmx_range_t *ranges, uint8_t n, uint16_t first, uint16_t last) {
+    artnet_dmx_range_t *r;
+
+    if (n > 0) {
+        r = &ranges[n - 1];
+        if (first <= r->start + r->length + ARTNET_DIRTY_GAP || n == ARTNET_MAX_DIRTY_RANGES) {
+            r->length = last + 1 - r->start;
+            return n;
+        }
+    }
+
+    ranges[n].start = first;
+    ranges[n].length = last + 1 - first;
+    return n + 1;
+}
+
+/*
+ * Compare data against last a word at a time, record the changed slot
+ * ranges and update last.
+ * Returns the number of ranges, 0 if nothing changed.
+ */
+uint8_t LAN_diff_frame(uint8_t *last, uint16_t last_length,
+        const uint8_t *data, uint16_t length, artnet_dmx_range_t *ranges) {
+    uint32_t a, b, x;
+    uint16_t i, words = length & ~3;
+    uint8_t n = 0;
+
+    for (i = 0; i < words; i += 4) {
+        memcpy(&a, last + i, 4);
+        memcpy(&b, data + i, 4);
+        if ((x = a ^ b) == 0)
+            continue;
+
+        memcpy(last + i, &b, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        n = add_range(ranges, n, i + __builtin_clz(x) / 8, i + (31 - __builtin_ctz(x)) / 8);
+#else
+        n = add_range(ranges, n, i + __builtin_ctz(x) / 8, i + (31 - __builtin_clz(x)) / 8);
+#endif
+    }
+
+    for (; i < length; i++) {
+        if (last[i] != data[i]) {
+            last[i] = data[i];
+            n = add_range(ranges, n, i, i);
+        }
+    }
+
+    // a shorter frame clears the slots it no longer carries
+    if (length < last_length) {
+        memset(last + length, 0x00, last_length - length);
+        n = add_range(ranges, n, length, last_length - 1);
+    } else if (length > last_length) {
+        // the new slots count as changed, ranges found in them are folded in
+        while (n > 0 && ranges[n - 1].start >= last_length)
+            n--;
+        n = add_range(ranges, n, last_length, length - 1);
+    }
+
+    return n;
+}
+
+/*
+ * Copy the sequence counters of an output port.
+ */
+int LAN_get_seq(artnet_node_t *node, uint8_t port, artnet_seq_t *seq) {
+    if (port >= ARTNET_MAX_NODE_PORTS || seq == NULL)
+        return ARTNET_EARG;
+
+    memcpy(seq, &node->seq[port], sizeof(*seq));
+    return ARTNET_EOK;
+}
+
+/*
+ * Give a port two buffers of ARTNET_DMX_LENGTH bytes (buffers points to
+ * both, back to back) so its frames can wait for ArtSync. NULL turns
+ * synchronous output off for the port.
+ */
+int LAN_set_port_sync(artnet_node_t *node, uint8_t port, uint8_t *buffers) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    memset(&node->sync[port], 0x00, sizeof(node->sync[port]));
+    if (buffers != NULL) {
+        node->sync[port].buf[0] = buffers;
+        node->sync[port].buf[1] = buffers + ARTNET_DMX_LENGTH;
+    }
+    return ARTNET_EOK;
+}
+
+static inline void count_callback(artnet_node_t *node, uint32_t start) {
+    uint32_t elapsed = artnet_misc_time_us() - start;
+
+    node->stats.callbacks++;
+    node->stats.callback_us += elapsed;
+    if (elapsed > node->stats.callback_max_us)
+        node->stats.callback_max_us = elapsed;
+}
+
+/*
+ * Pass a frame of port to the application: the interpolator, which
+ * times every frame, then change detection, the fixture patch, the
+ * frame queue and the callbacks.
+ */
+void LAN_deliver_dmx(artnet_node_t *node, uint8_t port, artnet_dmx_view_t *view) {
+    artnet_dmx_range_t dirty[ARTNET_MAX_DIRTY_RANGES];
+    void (*cb)(uint16_t port, uint8_t *dmx);
+    uint32_t start;
+    uint16_t i;
+
+    view->dirty = NULL;
+    view->ndirty = 0;
+
+    // unchanged frames still count in the frame interval
+    if (node->interp[port] != NULL)
+        LAN_interp_stage(node->interp[port], view);
+
+    if (node->last_frame[port] != NULL) {
+        view->ndirty = LAN_diff_frame(node->last_frame[port], node->last_length[port],
+                view->data, view->length, dirty);
+        node->last_length[port] = view->length;
+        if (view->ndirty == 0)
+            return;
+        view->dirty = dirty;
+    }
+
+    if (node->patch != NULL)
+        LAN_patch_apply(node->patch, view);
+
+    if (node->queue[port] != NULL)
+        LAN_queue_publish(node->queue[port], view);
+
+    if (node->view_callback[port] != NULL) {
+        start = artnet_misc_time_us();
+        node->view_callback[port](view);
+        count_callback(node, start);
+        return;
+    }
+
+    cb = node->port_callback[port];
+    if (cb == NULL)
+        cb = node->dmx_callback;
+    if (cb == NULL || node->dmx_start + node->dmx_footprint > view->length)
+        return;
+
+    // with change detection, only call back if the slice changed
+    for (i = 0; i < view->ndirty; i++) {
+        if (dirty[i].start < node->dmx_start + node->dmx_footprint
+                && dirty[i].start + dirty[i].length > node->dmx_start)
+            break;
+    }
+    if (view->dirty == NULL || i < view->ndirty) {
+        start = artnet_misc_time_us();
+        cb(port, (uint8_t *) view->data + node->dmx_start);
+        count_callback(node, start);
+    }
+}
+
+/*
+ * Output every universe waiting in a back buffer at once
+ */
+static void flush_sync(artnet_node_t *node) {
+    artnet_dmx_view_t view;
+    artnet_sync_buffer_t *sync;
+    uint8_t swapped[ARTNET_MAX_NODE_PORTS];
+    uint8_t port, i, nswapped = 0;
+
+    // flip every port first, then call back
+    for (port = 0; port < ARTNET_MAX_NODE_PORTS; port++) {
+        sync = &node->sync[port];
+        if (sync->pending) {
+            sync->front = !sync->front;
+            sync->pending = 0;
+            swapped[nswapped++] = port;
+        }
+    }
+
+    for (i = 0; i < nswapped; i++) {
+        port = swapped[i];
+        sync = &node->sync[port];
+        memset(&view, 0x00, sizeof(view));
+        view.data = sync->buf[sync->front];
+        view.length = sync->length[sync->front];
+        view.sequence = sync->sequence[sync->front];
+        view.universe = node->port_addr[port];
+        view.port = port;
+        LAN_deliver_dmx(node, port, &view);
+    }
+}
+
+/*
+ * Go back to asynchronous output once ArtSyncs have stopped for
+ * ARTNET_SYNC_TIMEOUT_MS, what was waiting for one goes out first.
+ * LAN_tick calls it, so this happens on time without any traffic.
+ */
+void LAN_sync_tick(artnet_node_t *node) {
+    if (node->sync_active && artnet_misc_time_ms() - node->sync_last > ARTNET_SYNC_TIMEOUT_MS) {
+        node->sync_active = 0;
+        flush_sync(node);
+    }
+}
+
+void LAN_handle_dmx(artnet_node_t *node, artnet_packet_t *p) {
+    artnet_dmx_view_t view;
+    artnet_sync_buffer_t *sync;
+    uint32_t now;
+    uint16_t length;
+    int port, slot;
+
+    port = LAN_find_port(node, p->data.admx.universe & ARTNET_PORT_ADDRESS_MASK);
+    if (port < 0) {
+        node->stats.rx_unsubscribed++;
+        return;
+    }
+
+    // LAN_get_type checked it against the received length
+    length = (p->data.admx.lengthHi << 8) | p->data.admx.length;
+    view.universe = p->data.admx.universe & ARTNET_PORT_ADDRESS_MASK;
+    view.sequence = p->data.admx.sequence;
+
+    now = artnet_misc_time_ms();
+    LAN_sync_tick(node);
+
+    for (; port >= 0; port = node->port_next[port] - 1) {
+        // the sequence slot of a source is only taken once merge accepts it
+        slot = seq_find(&node->seq[port], p->from.s_addr);
+        if (seq_stale(&node->seq[port], slot, view.sequence))
+            continue;
+
+        view.port = port;
+        view.data = p->data.admx.data;
+        view.length = length;
+
+        // merging replaces the view with the merged frame, or drops it
+        if (node->merge[port] != NULL
+                && LAN_merge_frame(node, port, p->from, &view) != ARTNET_EOK)
+            continue;
+        seq_accept(&node->seq[port], slot, p->from.s_addr, view.sequence);
+
+        LAN_loss_seen(node, port, &view, now);
+
+        // in synchronous mode the frame waits in the back buffer
+        sync = &node->sync[port];
+        if (node->sync_active && sync->buf[0] != NULL) {
+            memcpy(sync->buf[!sync->front], view.data, view.length);
+            sync->length[!sync->front] = view.length;
+            sync->sequence[!sync->front] = view.sequence;
+            sync->pending = 1;
+            continue;
+        }
+
+        LAN_deliver_dmx(node, port, &view);
+    }
+}
+
+/*
+ * ArtSync: output every universe waiting in a back buffer at once, and
+ * stay in synchronous mode until ArtSyncs stop coming.
+ */
+void LAN_handle_sync(artnet_node_t *node, artnet_packet_t *p) {
+    (void) p;
+    node->sync_active = 1;
+    node->sync_last = artnet_misc_time_ms();
+    flush_sync(node);
+}
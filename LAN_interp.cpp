@@ -0,0 +1,168 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * interp.c
+ * Upsampling of DMX frames to the output rate
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+/*
+ * Reset interp, every channel in snap mode. max_ticks bounds the ramp,
+ * typically the output rate over the slowest frame rate expected, at
+ * most ARTNET_INTERP_MAX_TICKS. Frames further apart are a pause and
+ * don't count in the frame interval.
+ */
+void LAN_interp_init(artnet_interp_t *interp, uint16_t max_ticks) {
+    memset(interp, 0x00, sizeof(*interp));
+    if (max_ticks > ARTNET_INTERP_MAX_TICKS)
+        max_ticks = ARTNET_INTERP_MAX_TICKS;
+    interp->max_ticks = max_ticks > 0 ? max_ticks : 1;
+}
+
+int LAN_interp_set_mode(artnet_interp_t *interp, uint16_t first, uint16_t count, artnet_interp_mode_t mode) {
+    uint16_t i;
+
+    if (first + count > ARTNET_DMX_LENGTH)
+        return ARTNET_EARG;
+
+    for (i = first; i < first + count; i++) {
+        if (mode == ARTNET_INTERP_LINEAR)
+            interp->linear[i >> 5] |= 1UL << (i & 31);
+        else
+            interp->linear[i >> 5] &= ~(1UL << (i & 31));
+    }
+    return ARTNET_EOK;
+}
+
+/*
+ * Network side: hand a frame to the output side.
+ */
+void LAN_interp_stage(artnet_interp_t *interp, const artnet_dmx_view_t *view) {
+    uint8_t seq = interp->seq;
+
+    artnet_misc_atomic_store(&interp->seq, seq + 1);
+    artnet_misc_fence();
+    memcpy(interp->staged, view->data, view->length);
+    interp->staged_length = view->length;
+    artnet_misc_atomic_store(&interp->seq, seq + 2);
+}
+
+/*
+ * Start ramping to the staged frame, seq is the counter read before.
+ * The frame is copied to target and checked before anything is derived
+ * from it. Returns false if the network side wrote it meanwhile, the
+ * ramp in progress then stops where it is, its target is gone.
+ */
+static bool adopt(artnet_interp_t *interp, uint8_t seq) {
+    uint16_t length = interp->staged_length;
+    uint16_t interval = interp->interval;
+    uint16_t i, ticks;
+    int32_t delta, mask, recip;
+
+    if (length > ARTNET_DMX_LENGTH)
+        length = ARTNET_DMX_LENGTH;
+    memcpy(interp->target, interp->staged, length);
+
+    artnet_misc_fence();
+    if (artnet_misc_atomic_load(&interp->seq) != seq) {
+        interp->remaining = 0;
+        return false;
+    }
+
+    if (interp->length == 0) {
+        // first frame, nothing to ramp from
+        ticks = 1;
+    } else {
+        // a pause or a keep-alive of a static look isn't a frame interval
+        if (interp->since < interp->max_ticks) {
+            if (interval == 0)
+                interval = interp->since << 4;
+            else
+                interval += ((int32_t) (interp->since << 4) - interval) >> ARTNET_INTERP_EWMA_SHIFT;
+        }
+
+        ticks = (interval + 8) >> 4;
+        if (ticks == 0)
+            ticks = 1;
+    }
+    // step = delta / ticks as a multiply, delta * 2^15 still fits. It
+    // rounds towards 0 so that ramps never overshoot.
+    recip = ticks > 1 ? 32768 / ticks : 0;
+
+    for (i = 0; i < length; i++) {
+        delta = (interp->target[i] << 8) - interp->value[i];
+        // all ones for linear channels, snap ones jump to the target now
+        mask = -(int32_t) ((interp->linear[i >> 5] >> (i & 31)) & 1);
+        interp->step[i] = (delta * recip / 32768) & mask;
+        interp->value[i] = (interp->value[i] & mask) | ((interp->target[i] << 8) & ~mask);
+    }
+
+    interp->applied = seq;
+    interp->interval = interval;
+    interp->length = length;
+    interp->remaining = ticks;
+    interp->since = 0;
+    return true;
+}
+
+/*
+ * Output side, once per output period (ISR safe): advance the ramps and
+ * write the 8 bit values to out if not NULL. The 8.8 values are in
+ * interp->value.
+ * Returns the number of channels.
+ */
+uint16_t LAN_interp_tick(artnet_interp_t *interp, uint8_t *out) {
+    uint8_t seq = artnet_misc_atomic_load(&interp->seq);
+    uint16_t i;
+
+    // a torn frame is adopted again at the next tick
+    if (seq != interp->applied && !(seq & 1))
+        adopt(interp, seq);
+
+    if (interp->since < 0xFFFF)
+        interp->since++;
+
+    if (interp->remaining > 0) {
+        if (--interp->remaining == 0) {
+            // land exactly on the frame
+            for (i = 0; i < interp->length; i++)
+                interp->value[i] = interp->target[i] << 8;
+        } else {
+            for (i = 0; i < interp->length; i++)
+                interp->value[i] += interp->step[i];
+        }
+    }
+
+    if (out != NULL) {
+        for (i = 0; i < interp->length; i++)
+            out[i] = (interp->value[i] + 0x80) >> 8;
+    }
+    return interp->length;
+}
+
+/*
+ * Stage the frames of port into interp (initialized with
+ * LAN_interp_init), NULL detaches it.
+ */
+int LAN_set_port_interp(artnet_node_t *node, uint8_t port, artnet_interp_t *interp) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    node->interp[port] = interp;
+    return ARTNET_EOK;
+}
@@ -0,0 +1,229 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * loss.c
+ * What ports do when their universe stops coming
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+/*
+ * Queue port in the wheel slot where deadline falls. Deadlines past the
+ * end of the wheel go to its last slot and are checked again from there.
+ */
+static void wheel_insert(artnet_node_t *node, uint8_t port, uint32_t deadline) {
+    artnet_loss_t *loss = &node->loss[port];
+    int32_t ahead = (int32_t) (deadline - node->loss_ms);
+    uint8_t slot;
+
+    // first slot processed at or after deadline, never the current one
+    ahead = ahead > 0 ? (ahead + ARTNET_LOSS_TICK_MS - 1) / ARTNET_LOSS_TICK_MS : 1;
+    if (ahead > ARTNET_LOSS_WHEEL_SLOTS - 1)
+        ahead = ARTNET_LOSS_WHEEL_SLOTS - 1;
+
+    slot = (node->loss_tick + ahead) % ARTNET_LOSS_WHEEL_SLOTS;
+    loss->wheel_next = node->loss_wheel[slot];
+    loss->in_wheel = 1;
+    node->loss_wheel[slot] = port + 1;
+}
+
+static void fade_remove(artnet_node_t *node, uint8_t port) {
+    uint8_t *prev = &node->loss_fading;
+
+    while (*prev != 0 && *prev != port + 1)
+        prev = &node->loss[*prev - 1].fade_next;
+    if (*prev != 0)
+        *prev = node->loss[port].fade_next;
+}
+
+static void deliver(artnet_node_t *node, uint8_t port, const uint8_t *data, uint16_t length) {
+    artnet_dmx_view_t view;
+
+    memset(&view, 0x00, sizeof(view));
+    view.data = data;
+    view.length = length;
+    view.universe = node->port_addr[port];
+    view.port = port;
+    LAN_deliver_dmx(node, port, &view);
+}
+
+/*
+ * The port timed out: report it and apply its policy
+ */
+static void lose(artnet_node_t *node, uint8_t port, uint32_t now) {
+    artnet_loss_t *loss = &node->loss[port];
+
+    loss->state = ARTNET_LOSS_LOST;
+    node->ports.output[port] &= ~PORT_STATUS_ACT_MASK;
+    LAN_invalidate_reply(node);
+
+    if (loss->policy == ARTNET_LOSS_FADE) {
+        loss->lost_at = now;
+        loss->last_step = now - ARTNET_LOSS_FADE_STEP_MS;
+        loss->fade_next = node->loss_fading;
+        node->loss_fading = port + 1;
+    } else if (loss->policy == ARTNET_LOSS_SCENE) {
+        deliver(node, port, loss->scene, ARTNET_DMX_LENGTH);
+    }
+
+    if (node->loss_callback != NULL)
+        node->loss_callback(port, 1);
+}
+
+/*
+ * Output the next frame of every fade, at most every
+ * ARTNET_LOSS_FADE_STEP_MS
+ */
+static void fade_step(artnet_node_t *node, uint32_t now) {
+    uint8_t frame[ARTNET_DMX_LENGTH];
+    uint8_t *prev = &node->loss_fading;
+    artnet_loss_t *loss;
+    uint32_t elapsed, level;
+    uint16_t i;
+    uint8_t port;
+
+    while (*prev != 0) {
+        port = *prev - 1;
+        loss = &node->loss[port];
+        elapsed = now - loss->lost_at;
+
+        if (elapsed < loss->fade && now - loss->last_step < ARTNET_LOSS_FADE_STEP_MS) {
+            prev = &loss->fade_next;
+            continue;
+        }
+
+        // 256 is full level
+        level = elapsed < loss->fade ? (loss->fade - elapsed) * 256 / loss->fade : 0;
+        for (i = 0; i < loss->length; i++)
+            frame[i] = (loss->look[i] * level) >> 8;
+        loss->last_step = now;
+        deliver(node, port, frame, loss->length);
+
+        if (level == 0)
+            *prev = loss->fade_next;
+        else
+            prev = &loss->fade_next;
+    }
+}
+
+/*
+ * Set what port does when its universe stops coming for timeout_ms
+ * (0 to never time out). buffer is a 512 bytes buffer holding the last
+ * look for ARTNET_LOSS_FADE, or the scene for ARTNET_LOSS_SCENE.
+ * The new settings apply from the next frame.
+ */
+int LAN_set_port_loss(artnet_node_t *node, uint8_t port, artnet_loss_policy_t policy,
+        uint16_t timeout_ms, uint16_t fade_ms, uint8_t *buffer) {
+    artnet_loss_t *loss;
+
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+    if (policy != ARTNET_LOSS_HOLD && buffer == NULL)
+        return ARTNET_EARG;
+
+    loss = &node->loss[port];
+    if (loss->state == ARTNET_LOSS_LOST)
+        fade_remove(node, port);
+
+    // a stale wheel entry is dropped, or reused by the next frame
+    loss->state = ARTNET_LOSS_IDLE;
+    loss->policy = policy;
+    loss->timeout = timeout_ms;
+    loss->fade = fade_ms;
+    loss->look = policy == ARTNET_LOSS_FADE ? buffer : NULL;
+    loss->scene = policy == ARTNET_LOSS_SCENE ? buffer : NULL;
+    loss->length = 0;
+    return ARTNET_EOK;
+}
+
+/*
+ * cb is called with lost set when a port times out, and cleared when its
+ * universe comes back
+ */
+void LAN_set_loss_callback(artnet_node_t *node, void (*cb)(uint16_t port, uint8_t lost)) {
+    node->loss_callback = cb;
+}
+
+/*
+ * A frame was received on port. Only stamps it while the port is
+ * receiving, the wheel finds out whether the stamp is recent enough.
+ */
+void LAN_loss_seen(artnet_node_t *node, uint8_t port, const artnet_dmx_view_t *view, uint32_t now) {
+    artnet_loss_t *loss = &node->loss[port];
+
+    loss->last_seen = now;
+    if (loss->look != NULL) {
+        memcpy(loss->look, view->data, view->length);
+        loss->length = view->length;
+    }
+    if (loss->state == ARTNET_LOSS_ARMED)
+        return;
+
+    if (loss->state == ARTNET_LOSS_LOST) {
+        fade_remove(node, port);
+        if (node->loss_callback != NULL)
+            node->loss_callback(port, 0);
+    }
+
+    loss->state = ARTNET_LOSS_ARMED;
+    node->ports.output[port] |= PORT_STATUS_ACT_MASK;
+    LAN_invalidate_reply(node);
+
+    if (!loss->in_wheel && loss->timeout > 0)
+        wheel_insert(node, port, now + loss->timeout);
+}
+
+/*
+ * Advance the wheel to now and time out the ports due, then step the
+ * fades. Only the slots elapsed are looked at, a port is checked once
+ * per timeout however many frames it receives.
+ */
+void LAN_loss_tick(artnet_node_t *node) {
+    uint32_t now = artnet_misc_time_ms();
+    artnet_loss_t *loss;
+    uint8_t port, next, slot;
+
+    // after a long pause, a single turn of the wheel covers everything
+    if (now - node->loss_ms > (uint32_t) ARTNET_LOSS_WHEEL_SLOTS * ARTNET_LOSS_TICK_MS)
+        node->loss_ms = now - ARTNET_LOSS_WHEEL_SLOTS * ARTNET_LOSS_TICK_MS;
+
+    while (now - node->loss_ms >= ARTNET_LOSS_TICK_MS) {
+        node->loss_ms += ARTNET_LOSS_TICK_MS;
+        node->loss_tick++;
+
+        slot = node->loss_tick % ARTNET_LOSS_WHEEL_SLOTS;
+        port = node->loss_wheel[slot];
+        node->loss_wheel[slot] = 0;
+
+        while (port != 0) {
+            loss = &node->loss[port - 1];
+            next = loss->wheel_next;
+            loss->in_wheel = 0;
+            if (loss->state == ARTNET_LOSS_ARMED && loss->timeout > 0) {
+                if ((int32_t) (now - (loss->last_seen + loss->timeout)) >= 0)
+                    lose(node, port - 1, now);
+                else
+                    wheel_insert(node, port - 1, loss->last_seen + loss->timeout);
+            }
+            port = next;
+        }
+    }
+
+    if (node->loss_fading != 0)
+        fade_step(node, now);
+}
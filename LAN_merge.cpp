@@ -0,0 +1,191 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * merge.c
+ * HTP/LTP merging of two sources on an output port
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+/*
+ * Attach merge state to an output port, or detach it with merge = NULL.
+ */
+int LAN_set_port_merge(artnet_node_t *node, uint8_t port, artnet_merge_t *merge, artnet_merge_mode_t mode) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    if (merge != NULL)
+        memset(merge, 0x00, sizeof(*merge));
+
+    node->merge[port] = merge;
+    node->ports.output[port] &= ~(PORT_STATUS_MERGE | PORT_STATUS_LPT_MODE);
+    return LAN_set_merge_mode(node, port, mode);
+}
+
+int LAN_set_merge_mode(artnet_node_t *node, uint8_t port, artnet_merge_mode_t mode) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+    if (node->merge[port] == NULL)
+        return ARTNET_ESTATE;
+
+    node->merge[port]->mode = mode;
+    if (mode == ARTNET_MERGE_LTP)
+        node->ports.output[port] |= PORT_STATUS_LPT_MODE;
+    else
+        node->ports.output[port] &= ~PORT_STATUS_LPT_MODE;
+    LAN_invalidate_reply(node);
+    return ARTNET_EOK;
+}
+
+/*
+ * Leave merge mode at the next frame of port: its source stays, the
+ * other one is dropped.
+ */
+int LAN_cancel_merge(artnet_node_t *node, uint8_t port) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+    if (node->merge[port] == NULL)
+        return ARTNET_ESTATE;
+
+    node->merge[port]->cancel = 1;
+    return ARTNET_EOK;
+}
+
+/*
+ * Per byte maximum of two words.
+ * The Cortex-M4 has it in two instructions, elsewhere do it with plain
+ * 32 bit arithmetic: no branch, no byte loop.
+ */
+static inline uint32_t htp_word(uint32_t a, uint32_t b) {
+#if defined(__ARM_FEATURE_SIMD32)
+    __USUB8(a, b);
+    return __SEL(a, b);
+#else
+    const uint32_t high = 0x80808080;
+    // bit 7 of each byte: low 7 bits of a >= low 7 bits of b
+    uint32_t low_ge = (a | high) - (b & ~high);
+    uint32_t ge = ((a & ~b) | (~(a ^ b) & low_ge)) & high;
+    uint32_t mask = (ge >> 7) * 0xFF;
+    return (a & mask) | (b & ~mask);
+#endif
+}
+
+/*
+ * out = max(a, b), slot by slot. length is rounded up to a multiple of
+ * 4, the buffers must be large enough for that.
+ */
+void LAN_merge_htp(uint8_t *out, const uint8_t *a, const uint8_t *b, uint16_t length) {
+    uint32_t wa, wb, wo;
+    uint16_t i;
+
+    for (i = 0; i < length; i += 4) {
+        memcpy(&wa, a + i, 4);
+        memcpy(&wb, b + i, 4);
+        wo = htp_word(wa, wb);
+        memcpy(out + i, &wo, 4);
+    }
+}
+
+/*
+ * Feed a frame from `from` to the merge of port and point view to the
+ * frame to output.
+ * Returns ARTNET_EACTION if the frame comes from a third source and
+ * must be dropped.
+ */
+int LAN_merge_frame(artnet_node_t *node, uint8_t port, in_addr from, artnet_dmx_view_t *view) {
+    artnet_merge_t *m = node->merge[port];
+    uint32_t now = artnet_misc_time_ms();
+    int i, slot = -1, active = 0;
+    uint16_t j;
+    uint8_t status;
+
+    for (i = 0; i < ARTNET_MERGE_SOURCES; i++) {
+        if (m->src[i].ip != 0 && now - m->src[i].last_seen > ARTNET_MERGE_TIMEOUT_MS)
+            m->src[i].ip = 0;
+        if (m->cancel && m->src[i].ip != from.s_addr)
+            m->src[i].ip = 0;
+
+        if (m->src[i].ip != 0)
+            active++;
+        if (m->src[i].ip == from.s_addr)
+            slot = i;
+        else if (m->src[i].ip == 0 && slot < 0)
+            slot = i;
+    }
+
+    m->cancel = 0;
+
+    // both slots taken by other sources, the spec says ignore it
+    if (slot < 0)
+        return ARTNET_EACTION;
+
+    /*
+     * LTP is decided slot by slot: a slot follows the source which changed
+     * it last. Compare with what this source sent before, a new source or
+     * a lone one sets every slot.
+     */
+    if (m->mode == ARTNET_MERGE_LTP) {
+        // active counts this source unless it is new
+        if (m->src[slot].ip == 0 ? active == 0 : active == 1) {
+            memcpy(m->out, view->data, view->length);
+            memset(m->out + view->length, 0x00, ARTNET_DMX_LENGTH - view->length);
+        } else if (m->src[slot].ip == 0) {
+            memcpy(m->out, view->data, view->length);
+        } else {
+            for (j = 0; j < view->length; j++) {
+                if (view->data[j] != m->src[slot].data[j])
+                    m->out[j] = view->data[j];
+            }
+        }
+    }
+
+    memcpy(m->src[slot].data, view->data, view->length);
+    if (view->length < m->src[slot].length)
+        memset(m->src[slot].data + view->length, 0x00, m->src[slot].length - view->length);
+    m->src[slot].length = view->length;
+    m->src[slot].ip = from.s_addr;
+    m->src[slot].last_seen = now;
+
+    active = 0;
+    for (i = 0; i < ARTNET_MERGE_SOURCES; i++) {
+        if (m->src[i].ip != 0)
+            active++;
+    }
+
+    status = node->ports.output[port];
+    if (active > 1)
+        node->ports.output[port] |= PORT_STATUS_MERGE;
+    else
+        node->ports.output[port] &= ~PORT_STATUS_MERGE;
+    if (status != node->ports.output[port])
+        LAN_invalidate_reply(node);
+
+    if (active > 1) {
+        if (m->src[1].length > view->length)
+            view->length = m->src[1].length;
+        if (m->src[0].length > view->length)
+            view->length = m->src[0].length;
+        if (m->mode == ARTNET_MERGE_HTP)
+            LAN_merge_htp(m->out, m->src[0].data, m->src[1].data, view->length);
+        view->data = m->out;
+    } else {
+        // single source: its frame goes out as is
+        view->data = m->src[slot].data;
+    }
+
+    return ARTNET_EOK;
+}
@@ -20,6 +20,9 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#ifndef __MBED__
+#include <time.h>
+#endif
 #include "LAN.h"
 
 // static buffer for the error strings
@@ -54,3 +57,77 @@ void artnet_misc_int_to_bytes(int data, uint8_t *bytes) {
     bytes[1] = (data & 0x00FF0000) >> 16;
     bytes[0] = (data & 0xFF000000) >> 24;
 }
+
+/*
+ * Free running microsecond clock, wraps every ~71 minutes so only use
+ * differences.
+ */
+uint32_t artnet_misc_time_us(void) {
+#ifdef __MBED__
+    return us_ticker_read();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/*
+ * Free running millisecond clock, wraps every ~49 days.
+ */
+uint32_t artnet_misc_time_ms(void) {
+#ifdef __MBED__
+    return (uint32_t) Kernel::get_ms_count();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/*
+ * Byte sized atomics, for the lock-free frame queue and the
+ * interpolator.
+ * GCC and clang have the builtins on both the target and the host, the
+ * other mbed toolchains go through the mbed critical API.
+ */
+uint8_t artnet_misc_atomic_load(volatile uint8_t *ptr) {
+#if defined(__GNUC__)
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#else
+    uint8_t value = *ptr;
+    __DMB();
+    return value;
+#endif
+}
+
+uint8_t artnet_misc_atomic_exchange(volatile uint8_t *ptr, uint8_t value) {
+#if defined(__GNUC__)
+    return __atomic_exchange_n(ptr, value, __ATOMIC_ACQ_REL);
+#else
+    uint8_t old = *ptr;
+    while (!core_util_atomic_cas_u8(ptr, &old, value))
+        ;
+    return old;
+#endif
+}
+
+void artnet_misc_atomic_store(volatile uint8_t *ptr, uint8_t value) {
+#if defined(__GNUC__)
+    __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#else
+    __DMB();
+    *ptr = value;
+#endif
+}
+
+/*
+ * Full memory barrier, orders the data of a seqlock with its counter.
+ */
+void artnet_misc_fence(void) {
+#if defined(__GNUC__)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#else
+    __DMB();
+#endif
+}
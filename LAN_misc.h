@@ -28,6 +28,12 @@ extern char artnet_errstr[256];
 // void artnet_error(const char *fmt, ...);
 int32_t artnet_misc_nbytes_to_32(uint8_t bytes[4]);
 void artnet_misc_int_to_bytes(int data, uint8_t *bytes);
+uint32_t artnet_misc_time_us(void);
+uint32_t artnet_misc_time_ms(void);
+uint8_t artnet_misc_atomic_load(volatile uint8_t *ptr);
+uint8_t artnet_misc_atomic_exchange(volatile uint8_t *ptr, uint8_t value);
+void artnet_misc_atomic_store(volatile uint8_t *ptr, uint8_t value);
+void artnet_misc_fence(void);
 
 // check if the node is null and return an error
 #define check_nullnode(node) if (node == NULL) { \
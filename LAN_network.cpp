@@ -21,46 +21,93 @@
 
 //#include <errno.h>
 
-
+#ifdef __MBED__
 #include "mbed.h"
 #include "NetworkInterface.h"
 #include "nsapi_types.h"
+#endif
 
 #include "LAN.h"
 #include "LAN_common.h"
 
 #define LOOPBACK_IP  (0x0100007F)
 
+#ifdef __MBED__
+static int sock_recv(artnet_transport_t *t, void *buf, int size, in_addr *from) {
+    SocketAddress client_addr;
+    nsapi_size_or_error_t len;
+
+    len = ((UDPSocket *) t->ctx)->recvfrom(&client_addr, buf, size);
+
+    if (len == NSAPI_ERROR_WOULD_BLOCK)
+        return ARTNET_ENODATA;
+
+    if (len < 0) {
+        return (int)len;
+    }
+
+    from->s_addr = inet_addr(client_addr.get_ip_address());
+    return len;
+}
+
+static int sock_send(artnet_transport_t *t, in_addr to, const void *buf, int length) {
+    SocketAddress addr;
+    uint8_t ip_bytes[ARTNET_IP_SIZE];
+
+    addr.set_port(ARTNET_PORT);
+    memcpy(&ip_bytes, &(to.s_addr), ARTNET_IP_SIZE);
+    addr.set_ip_bytes(ip_bytes, NSAPI_IPv4);
+
+    return ((UDPSocket *) t->ctx)->sendto(addr, buf, length);
+}
+
+/*
+ * Use an mbed UDP socket (bound to ARTNET_PORT, broadcast enabled).
+ * Every node has its own, so several can live in a process.
+ */
+void LAN_set_socket(artnet_node_t *node, UDPSocket *sock) {
+    node->sock_transport.recv = sock_recv;
+    node->sock_transport.send = sock_send;
+    node->sock_transport.ctx = sock;
+    node->transport = sock != NULL ? &node->sock_transport : NULL;
+}
+#endif
+
 /*
  * Receive a packet.
  */
 int LAN_recv(artnet_node_t *node, artnet_packet_t *p) {
-    ssize_t len;
-    SocketAddress client_addr;
-    in_addr_t client_ip;
+    int len;
+    in_addr from;
 
-    if (LAN_sock == NULL)
+    if (node->transport == NULL)
         return ARTNET_ENET;
 
     p->length = 0;
 
-    len = LAN_sock->recvfrom(&client_addr, &(p->data), sizeof(p->data));
+    len = node->transport->recv(node->transport, &(p->data), sizeof(p->data), &from);
 
     if (len < 0) {
-        return (int)len;
+        return len;
     }
+    node->stats.rx_packets++;
 
-    client_ip = inet_addr(client_addr.get_ip_address());
-
-    if (client_ip == node->ip_addr.s_addr || client_ip == LOOPBACK_IP) {
+    // our own packets, and loopback ones unless the node lives on loopback
+    if (from.s_addr == node->ip_addr.s_addr
+            || (from.s_addr == LOOPBACK_IP && (node->ip_addr.s_addr & 0xFF) != 0x7F)) {
+        node->stats.rx_filtered++;
         return ARTNET_EOK;
     }
 
     p->length = len;
-
-    memcpy(&(p->from), &client_ip, sizeof(struct in_addr));
+    p->from = from;
     // should set to in here if we need it
 
+#ifdef ARTNET_FEATURE_PCAP
+    if (node->capture != NULL)
+        LAN_pcap_write(node->capture, from, node->ip_addr, &(p->data), len);
+#endif
+
     return ARTNET_EOK;
 }
 
@@ -68,33 +115,37 @@ int LAN_recv(artnet_node_t *node, artnet_packet_t *p) {
  * Send a packet.
  */
 int LAN_send(artnet_node_t *node, artnet_packet_t *packet) {
-    SocketAddress addr;
-    uint8_t ip_bytes[ARTNET_IP_SIZE];
+    packet->from = node->ip_addr;
+    return LAN_sendto(node, packet->to, &packet->data, packet->length);
+}
+
+/*
+ * Send length bytes of an already serialized packet to `to`.
+ */
+int LAN_sendto(artnet_node_t *node, in_addr to, const void *data, int length) {
     int ret;
 
-    if (LAN_sock == NULL)
+    if (node->transport == NULL)
         return ARTNET_ENET;
 
     if (node->status != ARTNET_ON)
         return ARTNET_EACTION;
 
-    addr.set_port(ARTNET_PORT);
-    memcpy(&ip_bytes, &(packet->to.s_addr), ARTNET_IP_SIZE);
-    addr.set_ip_bytes(ip_bytes, NSAPI_IPv4);
-    packet->from = node->ip_addr;
-
-    ret = LAN_sock->sendto(addr, (void*)&packet->data, packet->length);
+    ret = node->transport->send(node->transport, to, data, length);
 
     if (ret < 0) {
         // artnet_error("Sendto failed: %d", ret);
-        node->report_code = ARTNET_RCUDPFAIL;
+        node->stats.tx_udp_fail++;
+        LAN_set_report_code(node, ARTNET_RCUDPFAIL);
         return ARTNET_ENET;
 
-    } else if (packet->length != ret) {
+    } else if (length != ret) {
         // artnet_error("failed to send full datagram");
-        node->report_code = ARTNET_RCSOCKETWR1;
+        node->stats.tx_short++;
+        LAN_set_report_code(node, ARTNET_RCSOCKETWR1);
         return ARTNET_ENET;
     }
 
+    node->stats.tx_packets++;
     return ARTNET_EOK;
 }
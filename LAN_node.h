@@ -0,0 +1,159 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * node.h
+ * The node structure, it embeds packets so lives apart from common.h
+ */
+
+#ifndef LAN_NODE_H_
+#define LAN_NODE_H_
+
+#include "LAN_common.h"
+#include "LAN_packets.h"
+
+/**
+ * What the node sends and receives through. recv returns the length of
+ * the datagram read in buf and its source in from, ARTNET_ENODATA if
+ * there is none, or an error. send returns the bytes sent or an error.
+ */
+typedef struct artnet_transport_s {
+  int (*recv)(struct artnet_transport_s *t, void *buf, int size, in_addr *from);
+  int (*send)(struct artnet_transport_s *t, in_addr to, const void *buf, int length);
+  void *ctx;
+} artnet_transport_t;
+
+struct artnet_pcap_writer_s;
+struct artnet_node_s;
+
+/**
+ * Application handler of the opcodes the library only parses (ArtTod*,
+ * ArtRdm, ArtFirmwareMaster), called with the packet as received.
+ */
+typedef void (*artnet_packet_callback_t)(struct artnet_node_s *node, artnet_packet_t *p);
+
+#ifdef ARTNET_FEATURE_INPUT
+/**
+ * A universe sent by the node. The ArtDmx is kept ready to go, writes
+ * go straight into its data.
+ */
+typedef struct artnet_tx_s {
+  artnet_dmx_t pkt;
+  in_addr to;               // 0 to broadcast, see LAN_tx_set_dest
+  uint32_t last_sent;       // ms
+  uint8_t dirty;            // data changed since last sent
+  struct artnet_tx_s *next;
+} artnet_tx_t;
+#endif
+
+/**
+ * The main node structure
+ */
+typedef struct artnet_node_s{
+  artnet_transport_t *transport;    // not owned
+  artnet_transport_t sock_transport;  // wraps the socket given to LAN_set_socket
+#ifdef ARTNET_FEATURE_PCAP
+  struct artnet_pcap_writer_s *capture; // records received packets if set
+#endif
+  artnet_packet_t packet;   // receive scratch of LAN_read(node, NULL)
+  uint8_t id[8];
+  uint8_t mac_addr[ARTNET_MAC_SIZE];
+  in_addr reply_addr;
+  in_addr ip_addr;
+  in_addr bcast_addr;
+  in_addr gateway_addr;
+  in_addr subnet_mask;
+  char short_name[ARTNET_SHORT_NAME_LENGTH];
+  char long_name[ARTNET_LONG_NAME_LENGTH];
+  char report[ARTNET_REPORT_LENGTH];
+  node_status_t status;
+  uint8_t indicator;        // artnet_indicator_t
+  struct ports_s {
+    uint8_t  types[ARTNET_MAX_NODE_PORTS];    // type of port
+    uint8_t output[ARTNET_MAX_NODE_PORTS]; // output ports
+    uint8_t input[ARTNET_MAX_NODE_PORTS]; // input ports
+  } ports;
+  uint8_t subnet_hi[ARTNET_MAX_PAGES];  // net switch of each page
+  uint8_t subnet_lo[ARTNET_MAX_PAGES];  // subnet switch of each page
+  uint8_t oem_hi;
+  uint8_t oem_lo;
+  uint8_t esta_hi;
+  uint8_t esta_lo;
+  uint8_t fmw_hi;
+  uint8_t fmw_lo;
+  uint8_t ubea;
+  uint8_t swin[ARTNET_MAX_NODE_PORTS];
+  uint8_t swout[ARTNET_MAX_NODE_PORTS];
+  uint8_t swvideo;
+  uint8_t swmacro;
+  uint8_t swremote;
+  artnet_node_report_code report_code;
+  void (*dmx_callback)(uint16_t portid, uint8_t *dmx);
+  void (*port_callback[ARTNET_MAX_NODE_PORTS])(uint16_t portid, uint8_t *dmx);
+  artnet_dmx_view_callback_t view_callback[ARTNET_MAX_NODE_PORTS];
+  artnet_merge_t *merge[ARTNET_MAX_NODE_PORTS];
+  artnet_seq_t seq[ARTNET_MAX_NODE_PORTS];
+  uint8_t *last_frame[ARTNET_MAX_NODE_PORTS];    // change detection, application owned
+  uint16_t last_length[ARTNET_MAX_NODE_PORTS];
+  artnet_sync_buffer_t sync[ARTNET_MAX_NODE_PORTS];
+  artnet_frame_queue_t *queue[ARTNET_MAX_NODE_PORTS];  // application owned
+  artnet_interp_t *interp[ARTNET_MAX_NODE_PORTS];      // application owned
+  uint8_t sync_active;      // an ArtSync was seen less than ARTNET_SYNC_TIMEOUT_MS ago
+  uint32_t sync_last;       // ms, last ArtSync
+  uint16_t port_addr[ARTNET_MAX_NODE_PORTS];     // Port-Address of each output port
+  uint8_t port_next[ARTNET_MAX_NODE_PORTS];      // next port (+1) sharing the same Port-Address
+  uint8_t port_hash[ARTNET_PORT_HASH_SIZE]; // Port-Address -> first port (+1), 0 if empty
+  artnet_patch_t *patch;    // application owned, see LAN_set_patch
+  uint16_t dmx_start;
+  uint16_t dmx_footprint;
+  uint16_t rx_max_packets;  // datagrams pulled per LAN_read call, 0 for no limit
+  uint32_t rx_max_us;       // time spent per LAN_read call, 0 for no limit
+  uint8_t rx_coalesce;      // only the newest ArtDmx of a universe in a batch is handled
+  artnet_reply_t reply[ARTNET_MAX_PAGES];  // serialized ArtPollReplies, rebuilt when reply_valid is 0
+  uint8_t reply_valid;
+  uint16_t reply_pages;     // pages answering ArtPolls, bit n for page n
+  in_addr reply_to;         // destination of the pending reply
+  uint8_t reply_pending;    // an ArtPoll is waiting for its reply
+  uint16_t reply_max_delay; // ms, 0 to answer from the receive loop
+  uint32_t reply_due;       // ms, when the pending reply goes out
+  uint32_t rand_state;      // xorshift state for the reply delay
+  uint8_t reply_changed;    // node conditions changed since the subscribers were told
+  artnet_controller_t controllers[ARTNET_MAX_CONTROLLERS];
+#ifdef ARTNET_FEATURE_INPUT
+  artnet_tx_t *tx_head;     // universes sent by the node
+  artnet_tx_t *tx_cursor;   // where the next LAN_tx_tick starts
+  uint16_t tx_budget;       // ArtDmx sent per tick, 0 for no limit
+  uint16_t tx_keepalive;    // ms between refreshes of unchanged universes
+#endif
+#ifdef ARTNET_FEATURE_TOD
+  artnet_packet_callback_t tod_callback;      // ArtTodRequest, ArtTodControl
+#endif
+#ifdef ARTNET_FEATURE_RDM
+  artnet_packet_callback_t rdm_callback;
+#endif
+#ifdef ARTNET_FEATURE_FIRMWARE
+  artnet_packet_callback_t firmware_callback;
+#endif
+  artnet_stats_t stats;
+  uint8_t persist_dirty;    // ARTNET_PERSIST_* changed by ArtAddress, not saved yet
+  uint32_t persist_due;     // ms, when they are handed out by LAN_persist_poll
+  artnet_loss_t loss[ARTNET_MAX_NODE_PORTS];
+  uint8_t loss_wheel[ARTNET_LOSS_WHEEL_SLOTS]; // first port (+1) due in each slot
+  uint32_t loss_tick;       // wheel slots processed so far
+  uint32_t loss_ms;         // ms, when the last one was due
+  uint8_t loss_fading;      // first port (+1) fading
+  void (*loss_callback)(uint16_t portid, uint8_t lost);
+} artnet_node_t;
+
+#endif
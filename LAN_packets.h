@@ -25,7 +25,12 @@
 #include <sys/types.h>
 #include <stdint.h>
 
+#ifdef __MBED__
 #include <inet.h>
+#else
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
 
 #include "LAN_common.h"
 
@@ -34,6 +39,7 @@ enum artnet_packet_type_e {
     ARTNET_POLL = 0x2000,
     ARTNET_REPLY = 0x2100,
     ARTNET_DMX = 0x5000,
+    ARTNET_SYNC = 0x5200,
     ARTNET_ADDRESS = 0x6000,
     ARTNET_INPUT = 0x7000,
     ARTNET_TODREQUEST = 0x8000,
@@ -174,8 +180,8 @@ struct artnet_address_s {
     uint16_t opCode;
     uint8_t  verH;
     uint8_t  ver;
-    uint8_t  filler1;
-    uint8_t  filler2;
+    uint8_t  netswitch;
+    uint8_t  bindindex;
     uint8_t  shortname[ARTNET_SHORT_NAME_LENGTH];
     uint8_t  longname[ARTNET_LONG_NAME_LENGTH];
     uint8_t  swin[ARTNET_MAX_PORTS];
@@ -203,14 +209,195 @@ struct artnet_dmx_s {
 
 typedef struct artnet_dmx_s artnet_dmx_t;
 
+// bytes before the first slot of an ArtDmx
+enum { ARTNET_DMX_HEADER_SIZE = sizeof(artnet_dmx_t) - ARTNET_DMX_LENGTH };
+
+
+struct artnet_sync_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  aux1;
+    uint8_t  aux2;
+} __attribute__((packed));
+
+typedef struct artnet_sync_s artnet_sync_t;
+
+
+#ifdef ARTNET_FEATURE_INPUT
+struct artnet_input_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  filler1;
+    uint8_t  bindindex;
+    uint8_t  numbportsH;
+    uint8_t  numbports;
+    uint8_t  input[ARTNET_MAX_PORTS];
+} __attribute__((packed));
+
+typedef struct artnet_input_s artnet_input_t;
+#endif
+
+
+#ifdef ARTNET_FEATURE_TOD
+struct artnet_todrequest_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  filler1;
+    uint8_t  filler2;
+    uint8_t  spare1;
+    uint8_t  spare2;
+    uint8_t  spare3;
+    uint8_t  spare4;
+    uint8_t  spare5;
+    uint8_t  spare6;
+    uint8_t  spare7;
+    uint8_t  net;
+    uint8_t  command;
+    uint8_t  adCount;
+    uint8_t  address[ARTNET_MAX_RDM_ADCOUNT];
+} __attribute__((packed));
+
+typedef struct artnet_todrequest_s artnet_todrequest_t;
+
+
+struct artnet_toddata_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  rdmVer;
+    uint8_t  port;
+    uint8_t  spare1;
+    uint8_t  spare2;
+    uint8_t  spare3;
+    uint8_t  spare4;
+    uint8_t  spare5;
+    uint8_t  spare6;
+    uint8_t  bindIndex;
+    uint8_t  net;
+    uint8_t  cmdRes;
+    uint8_t  address;
+    uint8_t  uidTotalHi;
+    uint8_t  uidTotal;
+    uint8_t  blockCount;
+    uint8_t  uidCount;
+    uint8_t  tod[ARTNET_MAX_UID_COUNT][ARTNET_RDM_UID_WIDTH];
+} __attribute__((packed));
+
+typedef struct artnet_toddata_s artnet_toddata_t;
+
+
+struct artnet_todcontrol_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  filler1;
+    uint8_t  filler2;
+    uint8_t  spare1;
+    uint8_t  spare2;
+    uint8_t  spare3;
+    uint8_t  spare4;
+    uint8_t  spare5;
+    uint8_t  spare6;
+    uint8_t  spare7;
+    uint8_t  net;
+    uint8_t  cmd;
+    uint8_t  address;
+} __attribute__((packed));
+
+typedef struct artnet_todcontrol_s artnet_todcontrol_t;
+#endif
+
 
-// union of all artnet packets
+#ifdef ARTNET_FEATURE_RDM
+struct artnet_rdm_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  rdmVer;
+    uint8_t  filler2;
+    uint8_t  spare1;
+    uint8_t  spare2;
+    uint8_t  spare3;
+    uint8_t  spare4;
+    uint8_t  spare5;
+    uint8_t  spare6;
+    uint8_t  spare7;
+    uint8_t  net;
+    uint8_t  cmd;
+    uint8_t  address;
+    uint8_t  data[ARTNET_MAX_RDM_DATA];
+} __attribute__((packed));
+
+typedef struct artnet_rdm_s artnet_rdm_t;
+
+// bytes before the RDM packet of an ArtRdm
+enum { ARTNET_RDM_HEADER_SIZE = sizeof(artnet_rdm_t) - ARTNET_MAX_RDM_DATA };
+#endif
+
+
+#ifdef ARTNET_FEATURE_FIRMWARE
+struct artnet_firmware_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  filler1;
+    uint8_t  filler2;
+    uint8_t  type;
+    uint8_t  blockId;
+    uint8_t  length[4];
+    uint8_t  spare[20];
+    uint16_t data[ARTNET_FIRMWARE_SIZE];
+} __attribute__((packed));
+
+typedef struct artnet_firmware_s artnet_firmware_t;
+
+
+struct artnet_firmware_reply_s {
+    uint8_t  id[8];
+    uint16_t opCode;
+    uint8_t  verH;
+    uint8_t  ver;
+    uint8_t  filler1;
+    uint8_t  filler2;
+    uint8_t  type;
+    uint8_t  spare[21];
+} __attribute__((packed));
+
+typedef struct artnet_firmware_reply_s artnet_firmware_reply_t;
+#endif
+
+
+// union of the packets a node receives, it sizes the receive buffers.
+// ArtPollReply, ArtTodData and ArtFirmwareReply are only sent.
 typedef union {
     artnet_poll_t ap;
-    artnet_reply_t ar;
     artnet_ipprog_t aip;
     artnet_address_t addr;
     artnet_dmx_t admx;
+    artnet_sync_t async;
+#ifdef ARTNET_FEATURE_INPUT
+    artnet_input_t ainput;
+#endif
+#ifdef ARTNET_FEATURE_TOD
+    artnet_todrequest_t todreq;
+    artnet_todcontrol_t todcontrol;
+#endif
+#ifdef ARTNET_FEATURE_RDM
+    artnet_rdm_t rdm;
+#endif
+#ifdef ARTNET_FEATURE_FIRMWARE
+    artnet_firmware_t firmware;
+#endif
 } artnet_packet_union_t;
 
 
@@ -0,0 +1,139 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * patch.c
+ * Fixture patch: frames gathered into per fixture parameter structs
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+
+/*
+ * Index of universe in patch->universes, or where to insert it.
+ */
+static uint8_t find_universe(const artnet_patch_t *patch, uint16_t universe) {
+    uint8_t lo = 0, hi = patch->nuniverses, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (patch->universes[mid].universe < universe)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Build the gather table of fixtures into patch, using ops (max_ops
+ * entries, one per parameter) as storage. Compile once, or again after
+ * repatching; frames are then applied with a single sweep per universe.
+ * Returns ARTNET_EARG if a parameter is beyond slot 512, ARTNET_EMEM if
+ * ops or the universe table is too small.
+ */
+int LAN_patch_compile(artnet_patch_t *patch, artnet_patch_op_t *ops, uint16_t max_ops,
+        const artnet_fixture_t *fixtures, uint16_t nfixtures) {
+    const artnet_fixture_t *f;
+    const artnet_channel_t *c;
+    artnet_patch_op_t op, *range;
+    uint16_t i, j, k, nops = 0, universe;
+    uint8_t u;
+
+    memset(patch, 0x00, sizeof(*patch));
+    patch->ops = ops;
+    patch->max_ops = max_ops;
+
+    // the universes, sorted
+    for (i = 0; i < nfixtures; i++) {
+        universe = fixtures[i].universe & ARTNET_PORT_ADDRESS_MASK;
+        u = find_universe(patch, universe);
+        if (u < patch->nuniverses && patch->universes[u].universe == universe)
+            continue;
+        if (patch->nuniverses == ARTNET_MAX_NODE_PORTS)
+            return ARTNET_EMEM;
+
+        memmove(&patch->universes[u + 1], &patch->universes[u],
+                (patch->nuniverses - u) * sizeof(patch->universes[0]));
+        patch->universes[u].universe = universe;
+        patch->nuniverses++;
+    }
+
+    // then their parameters, in slot order
+    for (u = 0; u < patch->nuniverses; u++) {
+        patch->universes[u].first = nops;
+
+        for (i = 0; i < nfixtures; i++) {
+            f = &fixtures[i];
+            if ((f->universe & ARTNET_PORT_ADDRESS_MASK) != patch->universes[u].universe)
+                continue;
+
+            for (j = 0; j < f->nchannels; j++) {
+                c = &f->channels[j];
+                op.dst = (uint8_t *) f->params + c->offset;
+                op.coarse = f->start + c->coarse;
+                op.fine = c->fine == ARTNET_CHANNEL_8BIT ? ARTNET_PATCH_8BIT : f->start + c->fine;
+                if (op.coarse >= ARTNET_DMX_LENGTH
+                        || (op.fine != ARTNET_PATCH_8BIT && op.fine >= ARTNET_DMX_LENGTH))
+                    return ARTNET_EARG;
+                if (nops == max_ops)
+                    return ARTNET_EMEM;
+
+                // insertion sort, fixtures are usually declared in order
+                range = &ops[patch->universes[u].first];
+                for (k = nops - patch->universes[u].first; k > 0 && range[k - 1].coarse > op.coarse; k--)
+                    range[k] = range[k - 1];
+                range[k] = op;
+                nops++;
+            }
+        }
+        patch->universes[u].count = nops - patch->universes[u].first;
+    }
+
+    return ARTNET_EOK;
+}
+
+/*
+ * Fill the parameters of the fixtures on the universe of view.
+ * Parameters beyond the end of a short frame are left alone.
+ */
+void LAN_patch_apply(const artnet_patch_t *patch, const artnet_dmx_view_t *view) {
+    const artnet_patch_op_t *op, *end;
+    const uint8_t *data = view->data;
+    uint16_t value;
+    uint8_t u;
+
+    u = find_universe(patch, view->universe);
+    if (u == patch->nuniverses || patch->universes[u].universe != view->universe)
+        return;
+
+    op = &patch->ops[patch->universes[u].first];
+    end = op + patch->universes[u].count;
+    for (; op < end && op->coarse < view->length; op++) {
+        if (op->fine == ARTNET_PATCH_8BIT) {
+            *op->dst = data[op->coarse];
+        } else if (op->fine < view->length) {
+            value = (data[op->coarse] << 8) | data[op->fine];
+            memcpy(op->dst, &value, sizeof(value));
+        }
+    }
+}
+
+/*
+ * Fill the fixtures of patch from every frame the node outputs, before
+ * the callbacks are called. NULL detaches it.
+ */
+void LAN_set_patch(artnet_node_t *node, artnet_patch_t *patch) {
+    node->patch = patch;
+}
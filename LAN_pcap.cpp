@@ -0,0 +1,400 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * pcap.c
+ * Capture of received packets to pcap files, and replay of them
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+#ifdef ARTNET_FEATURE_PCAP
+#include <time.h>
+#ifndef __MBED__
+#include <unistd.h>
+#endif
+
+enum {
+    PCAP_MAGIC_US = 0xa1b2c3d4,
+    PCAP_MAGIC_NS = 0xa1b23c4d,
+    PCAP_SNAPLEN = 65535,
+};
+
+// link types we read, raw IPv4 is what we write
+enum {
+    LINKTYPE_NULL = 0,
+    LINKTYPE_ETHERNET = 1,
+    LINKTYPE_RAW = 101,
+    LINKTYPE_LINUX_SLL = 113,
+    LINKTYPE_IPV4 = 228,
+    LINKTYPE_LINUX_SLL2 = 276,
+};
+
+enum { IP_HEADER_SIZE = 20, UDP_HEADER_SIZE = 8 };
+
+// largest part of a record we look at, Art-Net packets are smaller
+enum { PCAP_RECORD_MAX = 64 + sizeof(artnet_packet_union_t) };
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_header_t;
+
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} pcap_record_t;
+
+static inline uint16_t get_be16(const uint8_t *b) {
+    return (b[0] << 8) | b[1];
+}
+
+static inline uint32_t swap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+
+static void sleep_us(uint32_t us) {
+#ifdef __MBED__
+    wait_us(us);
+#else
+    usleep(us);
+#endif
+}
+
+/*
+ * Start recording to path, overwriting it.
+ */
+int LAN_pcap_open_capture(artnet_pcap_writer_t *writer, const char *path) {
+    pcap_header_t header;
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL)
+        return ARTNET_EARG;
+
+    header.magic = PCAP_MAGIC_US;
+    header.version_major = 2;
+    header.version_minor = 4;
+    header.thiszone = 0;
+    header.sigfigs = 0;
+    header.snaplen = PCAP_SNAPLEN;
+    header.linktype = LINKTYPE_RAW;
+
+    if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        fclose(writer->file);
+        writer->file = NULL;
+        return ARTNET_EACTION;
+    }
+
+    writer->clock_us = (uint64_t) time(NULL) * 1000000;
+    writer->last_us = artnet_misc_time_us();
+    writer->ip_id = 0;
+    return ARTNET_EOK;
+}
+
+/*
+ * Append a datagram, wrapped in IPv4 and UDP headers.
+ */
+int LAN_pcap_write(artnet_pcap_writer_t *writer, in_addr from, in_addr to, const void *data, int length) {
+    uint8_t hdr[IP_HEADER_SIZE + UDP_HEADER_SIZE];
+    pcap_record_t record;
+    uint32_t now, sum = 0;
+    uint16_t total = IP_HEADER_SIZE + UDP_HEADER_SIZE + length;
+    int i;
+
+    if (writer->file == NULL)
+        return ARTNET_ESTATE;
+
+    now = artnet_misc_time_us();
+    writer->clock_us += now - writer->last_us;
+    writer->last_us = now;
+
+    record.ts_sec = writer->clock_us / 1000000;
+    record.ts_frac = writer->clock_us % 1000000;
+    record.incl_len = total;
+    record.orig_len = total;
+
+    memset(hdr, 0x00, sizeof(hdr));
+    hdr[0] = 0x45;
+    hdr[2] = total >> 8;
+    hdr[3] = total & 0xFF;
+    hdr[4] = writer->ip_id >> 8;
+    hdr[5] = writer->ip_id & 0xFF;
+    writer->ip_id++;
+    hdr[8] = 64;    // ttl
+    hdr[9] = 17;    // udp
+    memcpy(&hdr[12], &from.s_addr, 4);
+    memcpy(&hdr[16], &to.s_addr, 4);
+    for (i = 0; i < IP_HEADER_SIZE; i += 2)
+        sum += get_be16(&hdr[i]);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = ~((sum & 0xFFFF) + (sum >> 16));
+    hdr[10] = (sum >> 8) & 0xFF;
+    hdr[11] = sum & 0xFF;
+
+    hdr[20] = ARTNET_PORT >> 8;
+    hdr[21] = ARTNET_PORT & 0xFF;
+    hdr[22] = ARTNET_PORT >> 8;
+    hdr[23] = ARTNET_PORT & 0xFF;
+    hdr[24] = (UDP_HEADER_SIZE + length) >> 8;
+    hdr[25] = (UDP_HEADER_SIZE + length) & 0xFF;
+
+    if (fwrite(&record, sizeof(record), 1, writer->file) != 1
+            || fwrite(hdr, sizeof(hdr), 1, writer->file) != 1
+            || fwrite(data, length, 1, writer->file) != 1)
+        return ARTNET_EACTION;
+
+    return ARTNET_EOK;
+}
+
+void LAN_pcap_close_capture(artnet_pcap_writer_t *writer) {
+    if (writer->file != NULL)
+        fclose(writer->file);
+    writer->file = NULL;
+}
+
+/*
+ * Record every packet the node receives (after the own/loopback
+ * filter), NULL stops recording.
+ */
+void LAN_set_capture(artnet_node_t *node, artnet_pcap_writer_t *writer) {
+    node->capture = writer;
+}
+
+/*
+ * Read records until one holds an Art-Net datagram, into replay->next.
+ * Returns 0 at the end of the file.
+ */
+static int read_next(artnet_pcap_replay_t *replay) {
+    uint8_t buf[PCAP_RECORD_MAX];
+    pcap_record_t record;
+    const uint8_t *ip, *udp;
+    uint32_t len, off, proto;
+    int payload;
+
+    while (fread(&record, sizeof(record), 1, replay->file) == 1) {
+        if (replay->swapped) {
+            record.ts_sec = swap32(record.ts_sec);
+            record.ts_frac = swap32(record.ts_frac);
+            record.incl_len = swap32(record.incl_len);
+        }
+
+        len = record.incl_len < sizeof(buf) ? record.incl_len : sizeof(buf);
+        if (fread(buf, len, 1, replay->file) != 1)
+            return 0;
+        if (record.incl_len > len && fseek(replay->file, record.incl_len - len, SEEK_CUR) != 0)
+            return 0;
+
+        // find the IPv4 header
+        switch (replay->linktype) {
+            case LINKTYPE_ETHERNET:
+                off = 14;
+                proto = len >= 14 ? get_be16(&buf[12]) : 0;
+                if (proto == 0x8100 && len >= 18) {
+                    proto = get_be16(&buf[16]);
+                    off = 18;
+                }
+                break;
+            case LINKTYPE_LINUX_SLL:
+                off = 16;
+                proto = len >= 16 ? get_be16(&buf[14]) : 0;
+                break;
+            case LINKTYPE_LINUX_SLL2:
+                off = 20;
+                proto = len >= 20 ? get_be16(&buf[0]) : 0;
+                break;
+            case LINKTYPE_NULL:
+                off = 4;
+                proto = 0x0800;
+                break;
+            default:
+                // LINKTYPE_RAW and LINKTYPE_IPV4, LAN_pcap_open_replay
+                // turned the others down
+                off = 0;
+                proto = 0x0800;
+                break;
+        }
+
+        if (proto != 0x0800 || len < off + IP_HEADER_SIZE)
+            continue;
+
+        ip = &buf[off];
+        if ((ip[0] >> 4) != 4 || ip[9] != 17)
+            continue;
+        // skip fragments, Art-Net datagrams fit in one frame
+        if ((ip[6] & 0x3F) != 0 || ip[7] != 0)
+            continue;
+
+        off += (ip[0] & 0x0F) * 4;
+        if (len < off + UDP_HEADER_SIZE)
+            continue;
+        udp = &buf[off];
+        if (get_be16(&udp[2]) != ARTNET_PORT)
+            continue;
+
+        payload = get_be16(&udp[4]) - UDP_HEADER_SIZE;
+        if (payload > (int) (len - off - UDP_HEADER_SIZE))
+            payload = len - off - UDP_HEADER_SIZE;
+        if (payload > (int) sizeof(replay->next.data))
+            payload = sizeof(replay->next.data);
+        if (payload <= 0)
+            continue;
+
+        memcpy(replay->next.data, udp + UDP_HEADER_SIZE, payload);
+        memcpy(&replay->next.from.s_addr, &ip[12], 4);
+        replay->next.length = payload;
+        replay->next.ts_us = (uint64_t) record.ts_sec * 1000000
+            + (replay->nsec ? record.ts_frac / 1000 : record.ts_frac);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Microseconds until the next packet is due, 0 if it is.
+ */
+static uint32_t time_to_next(artnet_pcap_replay_t *replay) {
+    uint32_t now = artnet_misc_time_us();
+    uint64_t due;
+
+    replay->clock_us += now - replay->last_us;
+    replay->last_us = now;
+
+    if (replay->speed_percent == 0)
+        return 0;
+
+    due = (replay->next.ts_us - replay->first_ts_us) * 100 / replay->speed_percent;
+    return due > replay->clock_us ? due - replay->clock_us : 0;
+}
+
+static int replay_recv(artnet_transport_t *t, void *buf, int size, in_addr *from) {
+    artnet_pcap_replay_t *replay = (artnet_pcap_replay_t *) t->ctx;
+
+    if (!replay->have_next) {
+        if (!read_next(replay)) {
+            replay->eof = 1;
+            return ARTNET_ENODATA;
+        }
+        if (replay->packets == 0)
+            replay->first_ts_us = replay->next.ts_us;
+        replay->have_next = 1;
+    }
+
+    if (time_to_next(replay) > 0)
+        return ARTNET_ENODATA;
+
+    if (size > replay->next.length)
+        size = replay->next.length;
+    memcpy(buf, replay->next.data, size);
+    *from = replay->next.from;
+    replay->have_next = 0;
+    replay->packets++;
+    return size;
+}
+
+static int replay_send(artnet_transport_t *t, in_addr to, const void *buf, int length) {
+    (void) to;
+    (void) buf;
+    ((artnet_pcap_replay_t *) t->ctx)->sent++;
+    return length;
+}
+
+/*
+ * Open a capture for replay. speed_percent scales the recorded timing:
+ * 100 replays it as it happened, 1000 ten times faster, 0 as fast as
+ * the node can take it.
+ */
+int LAN_pcap_open_replay(artnet_pcap_replay_t *replay, const char *path, unsigned speed_percent) {
+    pcap_header_t header;
+
+    memset(replay, 0x00, sizeof(*replay));
+    replay->file = fopen(path, "rb");
+    if (replay->file == NULL)
+        return ARTNET_EARG;
+
+    if (fread(&header, sizeof(header), 1, replay->file) != 1) {
+        LAN_pcap_close_replay(replay);
+        return ARTNET_EACTION;
+    }
+
+    if (header.magic == PCAP_MAGIC_US || header.magic == PCAP_MAGIC_NS) {
+        replay->nsec = header.magic == PCAP_MAGIC_NS;
+    } else if (header.magic == swap32(PCAP_MAGIC_US) || header.magic == swap32(PCAP_MAGIC_NS)) {
+        replay->swapped = 1;
+        replay->nsec = header.magic == swap32(PCAP_MAGIC_NS);
+        header.linktype = swap32(header.linktype);
+    } else {
+        LAN_pcap_close_replay(replay);
+        return ARTNET_EACTION;
+    }
+
+    replay->linktype = header.linktype & 0xFFFF;
+    switch (replay->linktype) {
+        case LINKTYPE_NULL:
+        case LINKTYPE_ETHERNET:
+        case LINKTYPE_RAW:
+        case LINKTYPE_LINUX_SLL:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_LINUX_SLL2:
+            break;
+        default:
+            LAN_pcap_close_replay(replay);
+            return ARTNET_EARG;
+    }
+    replay->speed_percent = speed_percent;
+    replay->transport.recv = replay_recv;
+    replay->transport.send = replay_send;
+    replay->transport.ctx = replay;
+    return ARTNET_EOK;
+}
+
+/*
+ * Feed the whole capture to node through LAN_read, in place of its
+ * socket, which is given back at the end. What the node sends is
+ * counted and dropped.
+ * Returns the number of packets replayed.
+ */
+long LAN_pcap_replay(artnet_node_t *node, artnet_pcap_replay_t *replay) {
+    artnet_transport_t *transport = node->transport;
+    uint32_t wait;
+
+    LAN_set_transport(node, &replay->transport);
+    replay->clock_us = 0;
+    replay->last_us = artnet_misc_time_us();
+
+    while (!replay->eof) {
+        LAN_read(node, NULL);
+
+        if (replay->have_next && (wait = time_to_next(replay)) > 0)
+            sleep_us(wait < 1000 ? wait : 1000);
+    }
+
+    LAN_set_transport(node, transport);
+    return replay->packets;
+}
+
+void LAN_pcap_close_replay(artnet_pcap_replay_t *replay) {
+    if (replay->file != NULL)
+        fclose(replay->file);
+    replay->file = NULL;
+}
+#endif
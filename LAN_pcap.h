@@ -0,0 +1,76 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * pcap.h
+ * Capture of received packets to pcap files, and replay of them
+ */
+
+#ifndef LAN_PCAP_H_
+#define LAN_PCAP_H_
+
+#include "LAN_node.h"
+
+#ifdef ARTNET_FEATURE_PCAP
+#include <stdio.h>
+
+/**
+ * Writes the packets a node receives to a pcap file, as raw IPv4/UDP
+ * so any pcap tool can read it.
+ */
+typedef struct artnet_pcap_writer_s {
+  FILE *file;
+  uint64_t clock_us;        // capture time, seeded from time() at open
+  uint32_t last_us;         // artnet_misc_time_us at the last packet
+  uint16_t ip_id;
+} artnet_pcap_writer_t;
+
+/**
+ * Reads Art-Net packets back from a pcap file, as the transport of a
+ * node. Ethernet, Linux cooked and raw IP captures are understood,
+ * other traffic in the file is skipped.
+ */
+typedef struct {
+  artnet_transport_t transport;
+  FILE *file;
+  uint32_t linktype;
+  uint8_t swapped;          // file written with the other byte order
+  uint8_t nsec;             // nanosecond timestamps
+  unsigned speed_percent;   // 100 original timing, 200 twice as fast, 0 no wait
+  uint64_t first_ts_us;     // timestamp of the first packet in the file
+  uint64_t clock_us;        // replay time since start
+  uint32_t last_us;
+  uint8_t have_next;        // next holds a packet not handed out yet
+  uint8_t eof;
+  struct {
+    uint64_t ts_us;
+    in_addr from;
+    int length;
+    uint8_t data[sizeof(artnet_packet_union_t)];
+  } next;
+  long packets;             // handed to the node so far
+  long sent;                // what the node sent back, dropped
+} artnet_pcap_replay_t;
+
+extern int LAN_pcap_open_capture(artnet_pcap_writer_t *writer, const char *path);
+extern int LAN_pcap_write(artnet_pcap_writer_t *writer, in_addr from, in_addr to, const void *data, int length);
+extern void LAN_pcap_close_capture(artnet_pcap_writer_t *writer);
+extern void LAN_set_capture(artnet_node_t *node, artnet_pcap_writer_t *writer);
+
+extern int LAN_pcap_open_replay(artnet_pcap_replay_t *replay, const char *path, unsigned speed_percent);
+extern long LAN_pcap_replay(artnet_node_t *node, artnet_pcap_replay_t *replay);
+extern void LAN_pcap_close_replay(artnet_pcap_replay_t *replay);
+#endif
+
+#endif
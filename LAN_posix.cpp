@@ -0,0 +1,165 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * posix.c
+ * POSIX UDP transport and epoll loop, for running nodes on a host
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+
+#if !defined(__MBED__) && defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+enum { ARTNET_EPOLL_EVENTS = 64 };
+
+static int posix_recv(artnet_transport_t *t, void *buf, int size, in_addr *from) {
+    artnet_posix_socket_t *sock = (artnet_posix_socket_t *) t->ctx;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    ssize_t len;
+
+    len = recvfrom(sock->fd, buf, size, 0, (struct sockaddr *) &addr, &addr_len);
+
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return ARTNET_ENODATA;
+        return ARTNET_ENET;
+    }
+
+    *from = addr.sin_addr;
+    return (int) len;
+}
+
+static int posix_send(artnet_transport_t *t, in_addr to, const void *buf, int length) {
+    artnet_posix_socket_t *sock = (artnet_posix_socket_t *) t->ctx;
+    struct sockaddr_in addr;
+
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(ARTNET_PORT);
+    addr.sin_addr = to;
+
+    return (int) sendto(sock->fd, buf, length, 0, (struct sockaddr *) &addr, sizeof(addr));
+}
+
+/*
+ * Open a non-blocking UDP socket bound to bind_addr:port, with broadcast
+ * enabled. Several virtual nodes can share a host by binding distinct
+ * addresses, 127.0.0.x on loopback for tests.
+ */
+int LAN_posix_open(artnet_posix_socket_t *sock, in_addr bind_addr, uint16_t port) {
+    struct sockaddr_in addr;
+    int on = 1;
+
+    sock->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock->fd < 0)
+        return ARTNET_ENET;
+
+    memset(&addr, 0x00, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr = bind_addr;
+
+    if (setsockopt(sock->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0
+            || setsockopt(sock->fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on)) < 0
+            || fcntl(sock->fd, F_SETFL, fcntl(sock->fd, F_GETFL) | O_NONBLOCK) < 0
+            || bind(sock->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sock->fd);
+        sock->fd = -1;
+        return ARTNET_ENET;
+    }
+
+    sock->transport.recv = posix_recv;
+    sock->transport.send = posix_send;
+    sock->transport.ctx = sock;
+    return ARTNET_EOK;
+}
+
+void LAN_posix_close(artnet_posix_socket_t *sock) {
+    if (sock->fd >= 0)
+        close(sock->fd);
+    sock->fd = -1;
+}
+
+int LAN_posix_loop_init(artnet_posix_loop_t *loop, artnet_node_t **nodes, int max_nodes) {
+    loop->epfd = epoll_create1(0);
+    if (loop->epfd < 0)
+        return ARTNET_ENET;
+
+    loop->nodes = nodes;
+    loop->nnodes = 0;
+    loop->max_nodes = max_nodes;
+    return ARTNET_EOK;
+}
+
+/*
+ * Make sock the transport of node and serve it from the loop.
+ */
+int LAN_posix_loop_add(artnet_posix_loop_t *loop, artnet_node_t *node, artnet_posix_socket_t *sock) {
+    struct epoll_event ev;
+
+    if (loop->nnodes >= loop->max_nodes)
+        return ARTNET_EMEM;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = node;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sock->fd, &ev) < 0)
+        return ARTNET_ENET;
+
+    LAN_set_transport(node, &sock->transport);
+    loop->nodes[loop->nnodes++] = node;
+    return ARTNET_EOK;
+}
+
+/*
+ * Wait up to timeout_ms for traffic, drain the sockets which have some,
+ * then tick the other nodes. Every node is ticked once per call.
+ * Returns the number of nodes which had traffic or an error.
+ */
+int LAN_posix_loop_run(artnet_posix_loop_t *loop, int timeout_ms) {
+    struct epoll_event events[ARTNET_EPOLL_EVENTS];
+    int i, j, n;
+
+    n = epoll_wait(loop->epfd, events, ARTNET_EPOLL_EVENTS, timeout_ms);
+    if (n < 0)
+        return errno == EINTR ? 0 : ARTNET_ENET;
+
+    // LAN_read ticks the nodes with traffic, tick the others for their timers
+    for (i = 0; i < n; i++)
+        LAN_read((artnet_node_t *) events[i].data.ptr, NULL);
+
+    for (i = 0; i < loop->nnodes; i++) {
+        for (j = 0; j < n && events[j].data.ptr != loop->nodes[i]; j++)
+            ;
+        if (j == n)
+            LAN_tick(loop->nodes[i]);
+    }
+
+    return n;
+}
+
+void LAN_posix_loop_close(artnet_posix_loop_t *loop) {
+    if (loop->epfd >= 0)
+        close(loop->epfd);
+    loop->epfd = -1;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * posix.h
+ * POSIX UDP transport and epoll loop, for running nodes on a host
+ */
+
+#ifndef LAN_POSIX_H_
+#define LAN_POSIX_H_
+
+#include "LAN_node.h"
+
+/**
+ * A non-blocking UDP socket, usable as the transport of one node.
+ */
+typedef struct {
+  artnet_transport_t transport;
+  int fd;
+} artnet_posix_socket_t;
+
+/**
+ * An epoll loop serving the sockets of many nodes.
+ */
+typedef struct {
+  int epfd;
+  artnet_node_t **nodes;  // provided by the application
+  int nnodes;
+  int max_nodes;
+} artnet_posix_loop_t;
+
+extern int LAN_posix_open(artnet_posix_socket_t *sock, in_addr bind_addr, uint16_t port);
+extern void LAN_posix_close(artnet_posix_socket_t *sock);
+
+extern int LAN_posix_loop_init(artnet_posix_loop_t *loop, artnet_node_t **nodes, int max_nodes);
+extern int LAN_posix_loop_add(artnet_posix_loop_t *loop, artnet_node_t *node, artnet_posix_socket_t *sock);
+extern int LAN_posix_loop_run(artnet_posix_loop_t *loop, int timeout_ms);
+extern void LAN_posix_loop_close(artnet_posix_loop_t *loop);
+
+#endif
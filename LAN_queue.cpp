@@ -0,0 +1,83 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * queue.c
+ * Single producer, single consumer frame hand-off
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+#include "LAN_misc.h"
+
+/*
+ * Publish the frames of port to queue as well as to the callbacks. The
+ * output thread or ISR picks them up with LAN_queue_read. NULL detaches
+ * the queue.
+ */
+int LAN_set_port_queue(artnet_node_t *node, uint8_t port, artnet_frame_queue_t *queue) {
+    if (port >= ARTNET_MAX_NODE_PORTS)
+        return ARTNET_EARG;
+
+    if (queue != NULL) {
+        memset(queue, 0x00, sizeof(*queue));
+        queue->back = 0;
+        queue->middle = 1;
+        queue->front = 2;
+        queue->port = port;
+    }
+    node->queue[port] = queue;
+    return ARTNET_EOK;
+}
+
+/*
+ * Network side: copy the frame in the back slot and swap it with the
+ * middle one, marked fresh.
+ */
+void LAN_queue_publish(artnet_frame_queue_t *queue, const artnet_dmx_view_t *view) {
+    uint8_t back = queue->back;
+
+    memcpy(queue->data[back], view->data, view->length);
+    queue->length[back] = view->length;
+    queue->sequence[back] = view->sequence;
+    // the Port-Address of the port may change, it travels with the frame
+    queue->universe[back] = view->universe;
+
+    queue->back = artnet_misc_atomic_exchange(&queue->middle, back | ARTNET_QUEUE_FRESH)
+        & ~ARTNET_QUEUE_FRESH;
+}
+
+/*
+ * Output side: get the newest frame, if one was published since the
+ * last call. view->data stays valid until the next LAN_queue_read.
+ * Returns 1 with view filled in, 0 if there is nothing new.
+ */
+int LAN_queue_read(artnet_frame_queue_t *queue, artnet_dmx_view_t *view) {
+    uint8_t front;
+
+    if (!(artnet_misc_atomic_load(&queue->middle) & ARTNET_QUEUE_FRESH))
+        return 0;
+
+    front = artnet_misc_atomic_exchange(&queue->middle, queue->front) & ~ARTNET_QUEUE_FRESH;
+    queue->front = front;
+
+    view->data = queue->data[front];
+    view->length = queue->length[front];
+    view->sequence = queue->sequence[front];
+    view->universe = queue->universe[front];
+    view->port = queue->port;
+    view->dirty = NULL;
+    view->ndirty = 0;
+    return 1;
+}
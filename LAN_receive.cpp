@@ -20,58 +20,316 @@
 
 #include "LAN.h"
 #include "LAN_common.h"
+#include "LAN_misc.h"
 
-int LAN_read(artnet_node_t *node, artnet_packet_t *p) {
-    int rtn;
-
-    while (true) {
-        memset(&p->data, 0x00, sizeof(p->data));
+static int classify(artnet_packet_t *p);
 
-        if ((rtn = LAN_recv(node, p)) < 0)
-            return rtn;
+/*
+ * sequence a is newer than b, 0 disables the check and the later
+ * packet wins
+ */
+static int seq_newer(uint8_t a, uint8_t b) {
+    return a != 0 && b != 0 && (int8_t) (a - b) > 0;
+}
 
-        // nothing to read
-        if (rtn == ARTNET_ENET)
-            break;
+/*
+ * Latest wins: empty every ArtDmx of the batch for which a newer frame
+ * of the same universe and source follows. Frames are never coalesced
+ * across an ArtSync, they belong to different synchronous frames.
+ */
+static void coalesce(artnet_node_t *node, artnet_packet_t *slots, int count) {
+    artnet_dmx_t *a, *b;
+    int i, j;
 
-        // skip this packet (filtered)
-        if (p->length == 0)
+    for (i = 0; i < count; i++) {
+        if (slots[i].length == 0 || slots[i].type != ARTNET_DMX)
             continue;
+        a = &slots[i].data.admx;
 
-        if (p->length > 12 && LAN_get_type(p)) {
-            LAN_handle(node, p);
+        for (j = i + 1; j < count; j++) {
+            if (slots[j].length == 0)
+                continue;
+            if (slots[j].type == ARTNET_SYNC)
+                break;
+            b = &slots[j].data.admx;
+            if (slots[j].type != ARTNET_DMX || b->universe != a->universe
+                    || slots[j].from.s_addr != slots[i].from.s_addr)
+                continue;
+
+            node->stats.rx_coalesced++;
+            if (seq_newer(a->sequence, b->sequence)) {
+                // reordered on the way, the later one is older
+                slots[j].length = 0;
+            } else {
+                slots[i].length = 0;
+                break;
+            }
         }
     }
-    return ARTNET_EOK;
 }
 
-int LAN_handle(artnet_node_t *node, artnet_packet_t *p) {
-    switch (p->type) {
-        case ARTNET_POLL:
-            LAN_handle_poll(node, p);
-            break;
-        case ARTNET_ADDRESS:
-            printf("address change");
+/*
+ * Read and handle every pending packet, one at a time in p, or in the
+ * node's own scratch packet if p is NULL.
+ */
+int LAN_read(artnet_node_t *node, artnet_packet_t *p) {
+    int rtn = LAN_read_batch(node, p != NULL ? p : &node->packet, 1);
+
+    return rtn < 0 ? rtn : ARTNET_EOK;
+}
+
+/*
+ * Pull up to nslots datagrams into slots, then handle them, until the
+ * socket is drained or the node rx budget is spent.
+ * Returns the number of datagrams pulled or an error.
+ */
+int LAN_read_batch(artnet_node_t *node, artnet_packet_t *slots, int nslots) {
+    uint32_t start = artnet_misc_time_us();
+    int pulled = 0;
+    int count, i, index, rtn = ARTNET_EOK;
+
+    if (slots == NULL || nslots <= 0)
+        return ARTNET_EARG;
+
+    while (rtn == ARTNET_EOK) {
+        count = 0;
+        while (count < nslots) {
+            if (node->rx_max_packets && pulled >= node->rx_max_packets)
+                break;
+
+            // no memset here, bytes past p->length are left from an earlier datagram
+            if ((rtn = LAN_recv(node, &slots[count])) < 0)
+                break;
+            pulled++;
+
+            // skip this packet (filtered)
+            if (slots[count].length == 0)
+                continue;
+            count++;
+        }
+
+        // unhandled and malformed packets are emptied, so later passes skip them
+        for (i = 0; i < count; i++) {
+            index = classify(&slots[i]);
+            if (index < 0)
+                node->stats.rx_malformed++;
+            else
+                node->stats.rx_opcode[index]++;
+            if (index <= 0)
+                slots[i].length = 0;
+        }
+
+        if (node->rx_coalesce)
+            coalesce(node, slots, count);
+
+        for (i = 0; i < count; i++) {
+            if (slots[i].length != 0)
+                LAN_handle(node, &slots[i]);
+        }
+
+        if (node->rx_max_packets && pulled >= node->rx_max_packets)
             break;
-        case ARTNET_DMX:
-            LAN_handle_dmx(node, p);
+        if (node->rx_max_us && artnet_misc_time_us() - start >= node->rx_max_us)
             break;
     }
 
+    LAN_tick(node);
+
+    if (rtn < 0 && rtn != ARTNET_ENODATA)
+        return rtn;
+    return pulled;
+}
+
+#ifdef ARTNET_FEATURE_INPUT
+/*
+ * ArtInput: enable or disable the input ports of a page
+ */
+static void handle_input(artnet_node_t *node, artnet_packet_t *p) {
+    uint8_t page = p->data.ainput.bindindex > 0 ? p->data.ainput.bindindex - 1 : 0;
+    uint8_t *input;
+    uint8_t i;
+
+    if (page >= ARTNET_MAX_PAGES)
+        return;
+
+    input = &node->ports.input[page * ARTNET_MAX_PORTS];
+    for (i = 0; i < ARTNET_MAX_PORTS && i < p->data.ainput.numbports; i++) {
+        if (p->data.ainput.input[i] & PORT_DISABLE_MASK)
+            input[i] |= PORT_STATUS_DISABLED_MASK;
+        else
+            input[i] &= ~PORT_STATUS_DISABLED_MASK;
+    }
+    LAN_invalidate_reply(node);
+}
+#endif
+
+#ifdef ARTNET_FEATURE_TOD
+static void handle_tod(artnet_node_t *node, artnet_packet_t *p) {
+    if (node->tod_callback != NULL)
+        node->tod_callback(node, p);
+}
+#endif
+
+#ifdef ARTNET_FEATURE_RDM
+static void handle_rdm(artnet_node_t *node, artnet_packet_t *p) {
+    if (node->rdm_callback != NULL)
+        node->rdm_callback(node, p);
+}
+#endif
+
+#ifdef ARTNET_FEATURE_FIRMWARE
+static void handle_firmware(artnet_node_t *node, artnet_packet_t *p) {
+    if (node->firmware_callback != NULL)
+        node->firmware_callback(node, p);
+}
+#endif
+
+typedef struct {
+    artnet_packet_type_t type;
+    uint16_t min_length;
+    void (*handle)(artnet_node_t *node, artnet_packet_t *p);
+} artnet_handler_t;
+
+/*
+ * Handled opcodes and the shortest packet each handler can work with,
+ * in artnet_stat_opcode_t order. ArtDmx is further checked against its
+ * own length field.
+ */
+static const artnet_handler_t handlers[] = {
+    { (artnet_packet_type_t) 0, 0, NULL },
+    { ARTNET_POLL, sizeof(artnet_poll_t), LAN_handle_poll },
+    { ARTNET_ADDRESS, sizeof(artnet_address_t), LAN_handle_address },
+    { ARTNET_DMX, ARTNET_DMX_HEADER_SIZE + 1, LAN_handle_dmx },
+    { ARTNET_SYNC, sizeof(artnet_sync_t), LAN_handle_sync },
+#ifdef ARTNET_FEATURE_INPUT
+    { ARTNET_INPUT, sizeof(artnet_input_t), handle_input },
+#endif
+#ifdef ARTNET_FEATURE_TOD
+    { ARTNET_TODREQUEST, sizeof(artnet_todrequest_t) - ARTNET_MAX_RDM_ADCOUNT, handle_tod },
+    { ARTNET_TODCONTROL, sizeof(artnet_todcontrol_t), handle_tod },
+#endif
+#ifdef ARTNET_FEATURE_RDM
+    { ARTNET_RDM, ARTNET_RDM_HEADER_SIZE, handle_rdm },
+#endif
+#ifdef ARTNET_FEATURE_FIRMWARE
+    { ARTNET_FIRMWAREMASTER, sizeof(artnet_firmware_t), handle_firmware },
+#endif
+};
+
+static_assert(sizeof(handlers) / sizeof(handlers[0]) == ARTNET_STAT_OPCODES,
+              "handlers must follow artnet_stat_opcode_t");
+
+// opcodes of disabled features map to 0
+#define OP_POLL     ARTNET_STAT_POLL
+#define OP_ADDRESS  ARTNET_STAT_ADDRESS
+#define OP_DMX      ARTNET_STAT_DMX
+#define OP_SYNC     ARTNET_STAT_SYNC
+#ifdef ARTNET_FEATURE_INPUT
+#define OP_INPUT    ARTNET_STAT_INPUT
+#else
+#define OP_INPUT    0
+#endif
+#ifdef ARTNET_FEATURE_TOD
+#define OP_TODREQ   ARTNET_STAT_TODREQUEST
+#define OP_TODCTL   ARTNET_STAT_TODCONTROL
+#else
+#define OP_TODREQ   0
+#define OP_TODCTL   0
+#endif
+#ifdef ARTNET_FEATURE_RDM
+#define OP_RDM      ARTNET_STAT_RDM
+#else
+#define OP_RDM      0
+#endif
+#ifdef ARTNET_FEATURE_FIRMWARE
+#define OP_FWMASTER ARTNET_STAT_FIRMWARE
+#else
+#define OP_FWMASTER 0
+#endif
+
+/*
+ * Opcode high byte -> index in handlers, 0 for opcodes we drop. All the
+ * handled opcodes have a zero low byte.
+ */
+static const uint8_t opcode_index[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x10
+    OP_POLL, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x20
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x30
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x40
+    OP_DMX, 0, OP_SYNC, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x50
+    OP_ADDRESS, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x60
+    OP_INPUT, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x70
+    OP_TODREQ, 0, OP_TODCTL, OP_RDM, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x80
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0x90
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xA0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xB0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xC0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xD0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xE0
+    0, 0, OP_FWMASTER, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  // 0xF0
+};
+
+/*
+ * "Art-Net\0" read as a single 64 bit word
+ */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const uint64_t ARTNET_ID = 0x4172742D4E657400ULL;
+#else
+static const uint64_t ARTNET_ID = 0x0074654E2D747241ULL;
+#endif
+
+int LAN_handle(artnet_node_t *node, artnet_packet_t *p) {
+    const artnet_handler_t *h = &handlers[opcode_index[(p->type >> 8) & 0xFF]];
+
+    if (h->handle != NULL && h->type == p->type)
+        h->handle(node, p);
+
     p->length = 0;
     return ARTNET_EOK;
 }
 
-int16_t LAN_get_type(artnet_packet_t *p) {
-    uint8_t *data;
+/*
+ * Classify a packet: check the id, look the opcode up and make sure
+ * the packet is long enough for its handler.
+ * Returns the index in handlers (0 for opcodes we don't handle), or -1
+ * if the packet is malformed.
+ */
+static int classify(artnet_packet_t *p) {
+    const uint8_t *data = (const uint8_t *) &p->data;
+    const artnet_handler_t *h;
+    uint64_t id;
+    uint16_t dmx_length;
+    uint8_t index;
+
+    if (p->length < ARTNET_STRING_SIZE + 2)
+        return -1;
+
+    memcpy(&id, data, sizeof(id));
+    if (id != ARTNET_ID)
+        return -1;
 
-    if (p->length < 10)
+    index = data[8] == 0 ? opcode_index[data[9]] : 0;
+    h = &handlers[index];
+    if (h->handle == NULL)
         return 0;
-    if (!memcmp(&p->data, ARTNET_STRING, ARTNET_STRING_SIZE)) {
-        data = (uint8_t *) &p->data;
-        p->type = (artnet_packet_type_t) (((data[9]) << 8) + (data[8]));
-        return p->type;
+    if (p->length < h->min_length)
+        return -1;
+
+    if (h->type == ARTNET_DMX) {
+        dmx_length = (p->data.admx.lengthHi << 8) | p->data.admx.length;
+        if (dmx_length == 0 || dmx_length > ARTNET_DMX_LENGTH
+                || p->length < ARTNET_DMX_HEADER_SIZE + dmx_length)
+            return -1;
     }
 
-    return 0;
+    p->type = h->type;
+    return index;
+}
+
+/*
+ * Returns the opcode, or 0 if the packet must be dropped.
+ */
+int16_t LAN_get_type(artnet_packet_t *p) {
+    return classify(p) > 0 ? p->type : 0;
 }
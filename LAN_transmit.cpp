@@ -20,32 +20,74 @@
 
 #include "LAN.h"
 #include "LAN_common.h"
+#include "LAN_misc.h"
 
 /*
  * Send an ArtPollReply
  * @param n the node
  * @param response true if this reply is in response to a network packet
  *            false if this reply is due to the node changing it's conditions
+ *
+ * One reply goes out per page in use. They are serialized once and kept
+ * in the node until a setter changes what they carry, only the report
+ * counter is patched here.
  */
 int LAN_send_poll_reply(artnet_node_t *node, int response) {
-  LAN_fill_poll_reply(node, &LAN_packet->data.ar);
+  artnet_reply_t *reply;
+  char *counter;
+  uint16_t count;
+  uint8_t page;
+  int rtn = ARTNET_EOK, ret;
+
+  if (!node->reply_valid) {
+    node->reply_pages = 0;
+    for (page = 0; page < ARTNET_MAX_PAGES; page++) {
+      LAN_fill_poll_reply(node, page, &node->reply[page]);
+      // the first page answers even without ports
+      if (page == 0 || node->reply[page].numbports != 0)
+        node->reply_pages |= 1 << page;
+    }
+    node->reply_valid = 1;
+  }
 
-  LAN_packet->to = node->reply_addr;
+  for (page = 0; page < ARTNET_MAX_PAGES; page++) {
+    if (!(node->reply_pages & (1 << page)))
+      continue;
+    reply = &node->reply[page];
 
-  LAN_packet->type = ARTNET_REPLY;
-  LAN_packet->length = sizeof(artnet_reply_t);
+    // "%04x [%04i] ...", the counter digits start at 6
+    count = node->stats.tx_replies++ % 10000;
+    counter = (char *) reply->nodereport + 6;
+    counter[3] = '0' + count % 10;
+    counter[2] = '0' + count / 10 % 10;
+    counter[1] = '0' + count / 100 % 10;
+    counter[0] = '0' + count / 1000;
 
-  snprintf((char *) &LAN_packet->data.ar.nodereport,
-           sizeof(LAN_packet->data.ar.nodereport),
-           "%04x [%04i] libartnet",
-           node->report_code,
-           0);
+    ret = LAN_sendto(node, node->reply_addr, reply, sizeof(artnet_reply_t));
+    if (ret != ARTNET_EOK)
+      rtn = ret;
+  }
+  return rtn;
+}
 
-  return LAN_send(node, LAN_packet);
+/*
+ * Drop the cached ArtPollReplies, to be called whenever a field they
+ * carry changes. The subscribed controllers are told on the next
+ * LAN_tick.
+ */
+void LAN_invalidate_reply(artnet_node_t *node) {
+  node->reply_valid = 0;
+  node->reply_changed = 1;
 }
 
-void LAN_fill_poll_reply(artnet_node_t *node, artnet_reply_t *poll_reply)
+/*
+ * Serialize the ArtPollReply of a page of ports.
+ */
+void LAN_fill_poll_reply(artnet_node_t *node, uint8_t page, artnet_reply_t *poll_reply)
 {
+    uint8_t first = page * ARTNET_MAX_PORTS;
+    uint8_t i;
+
     //fill to 0's
     memset (poll_reply, 0, sizeof(artnet_reply_t));
 
@@ -56,29 +98,168 @@ void LAN_fill_poll_reply(artnet_node_t *node, artnet_reply_t *poll_reply)
     memcpy (poll_reply->shortname, node->short_name, sizeof(poll_reply->shortname)); 
     memcpy (poll_reply->longname, node->long_name, sizeof(poll_reply->longname));
     memcpy (poll_reply->nodereport, node->report, sizeof(poll_reply->nodereport));
-    memcpy (poll_reply->porttypes, node->ports.types, sizeof(poll_reply->porttypes));
+    memcpy (poll_reply->porttypes, &node->ports.types[first], sizeof(poll_reply->porttypes));
 
-    memcpy (poll_reply->goodinput, node->ports.input, sizeof(poll_reply->goodinput));
-    memcpy (poll_reply->goodoutput, node->ports.output, sizeof(poll_reply->goodoutput));
+    memcpy (poll_reply->goodinput, &node->ports.input[first], sizeof(poll_reply->goodinput));
+    memcpy (poll_reply->goodoutput, &node->ports.output[first], sizeof(poll_reply->goodoutput));
 
-    memcpy (poll_reply->swin, node->swin, sizeof(poll_reply->swin));
-    memcpy (poll_reply->swout, node->swout, sizeof(poll_reply->swout));
+    memcpy (poll_reply->swin, &node->swin[first], sizeof(poll_reply->swin));
+    memcpy (poll_reply->swout, &node->swout[first], sizeof(poll_reply->swout));
     poll_reply->etsaman[0] = node->esta_hi;
     poll_reply->etsaman[1] = node->esta_lo;
 
     memcpy(poll_reply->id, node->id, sizeof(poll_reply->id));
+    memcpy(poll_reply->bind_ip, &node->ip_addr.s_addr, sizeof(poll_reply->bind_ip));
+
+    // ports up to the last one with a type
+    for (i = ARTNET_MAX_PORTS; i > 0 && node->ports.types[first + i - 1] == 0; i--)
+        ;
 
-    poll_reply->goodoutput[0]   = 0x80;
     poll_reply->opCode          = ARTNET_REPLY;  // ARTNET_REPLY
     poll_reply->port            = ARTNET_PORT;
     poll_reply->verH            = node->fmw_hi;
     poll_reply->ver             = node->fmw_lo;
-    poll_reply->subH            = node->subnet_hi;
-    poll_reply->sub             = node->subnet_lo;
+    poll_reply->subH            = node->subnet_hi[page];
+    poll_reply->sub             = node->subnet_lo[page];
     poll_reply->oemH            = node->oem_hi;
     poll_reply->oem             = node->oem_lo;
-    poll_reply->status          = node->status;
+    poll_reply->status          = node->status | node->indicator;
     poll_reply->numbportsH      = 0x00;
-    poll_reply->numbports       = 0x01;
+    poll_reply->numbports       = i;
     poll_reply->style           = ARTNET_NODE; 
+    poll_reply->bind_index      = page + 1;
+
+    snprintf((char *) &poll_reply->nodereport,
+             sizeof(poll_reply->nodereport),
+             "%04x [%04i] libartnet",
+             node->report_code,
+             (int) (node->stats.tx_replies % 10000));
+}
+
+#ifdef ARTNET_FEATURE_INPUT
+/*
+ * Start sending a universe. tx is owned by the application and stays
+ * linked in the node until LAN_tx_remove.
+ * length is the number of slots, rounded up to even as the spec wants.
+ */
+int LAN_tx_add(artnet_node_t *node, artnet_tx_t *tx, uint16_t port_addr, uint16_t length) {
+    artnet_tx_t **last;
+
+    if (tx == NULL || length == 0 || length > ARTNET_DMX_LENGTH)
+        return ARTNET_EARG;
+
+    // tx must not be zeroed while it is linked
+    for (last = &node->tx_head; *last != NULL; last = &(*last)->next) {
+        if (*last == tx)
+            return ARTNET_ESTATE;
+    }
+
+    length = (length + 1) & ~1;
+
+    memset(tx, 0x00, sizeof(*tx));
+    memcpy(tx->pkt.id, node->id, sizeof(tx->pkt.id));
+    tx->pkt.opCode = ARTNET_DMX;
+    tx->pkt.verH = 0;
+    tx->pkt.ver = ARTNET_VERSION;
+    tx->pkt.universe = port_addr & ARTNET_PORT_ADDRESS_MASK;
+    tx->pkt.lengthHi = length >> 8;
+    tx->pkt.length = length & 0xFF;
+    tx->dirty = 1;
+    *last = tx;
+    return ARTNET_EOK;
+}
+
+int LAN_tx_remove(artnet_node_t *node, artnet_tx_t *tx) {
+    artnet_tx_t **it;
+
+    for (it = &node->tx_head; *it != NULL; it = &(*it)->next) {
+        if (*it == tx) {
+            *it = tx->next;
+            if (node->tx_cursor == tx)
+                node->tx_cursor = tx->next;
+            return ARTNET_EOK;
+        }
+    }
+    return ARTNET_EARG;
+}
+
+/*
+ * Unicast a universe instead of broadcasting it, 0 goes back to the
+ * broadcast address of the node.
+ */
+void LAN_tx_set_dest(artnet_tx_t *tx, in_addr to) {
+    tx->to = to;
+}
+
+/*
+ * Update slots of a universe, it's only marked for sending if they
+ * actually changed.
+ */
+int LAN_tx_write(artnet_tx_t *tx, uint16_t offset, const uint8_t *data, uint16_t length) {
+    if (offset + length > ARTNET_DMX_LENGTH)
+        return ARTNET_EARG;
+
+    if (memcmp(tx->pkt.data + offset, data, length) != 0) {
+        memcpy(tx->pkt.data + offset, data, length);
+        tx->dirty = 1;
+    }
+    return ARTNET_EOK;
+}
+
+/*
+ * Limit the ArtDmx sent by one LAN_tx_tick (0 for no limit) and set how
+ * often unchanged universes are refreshed.
+ */
+void LAN_set_tx_budget(artnet_node_t *node, uint16_t max_packets, uint16_t keepalive_ms) {
+    node->tx_budget = max_packets;
+    node->tx_keepalive = keepalive_ms;
+}
+
+/*
+ * Send the universes which changed or are due for a refresh. When the
+ * budget runs out, the next tick resumes where this one stopped so no
+ * universe is starved.
+ * Returns the number of ArtDmx sent.
+ */
+int LAN_tx_tick(artnet_node_t *node) {
+    artnet_tx_t *tx, *start;
+    uint32_t now = artnet_misc_time_ms();
+    uint16_t length;
+    uint8_t sequence;
+    int sent = 0;
+
+    if (node->tx_head == NULL)
+        return 0;
+
+    start = node->tx_cursor != NULL ? node->tx_cursor : node->tx_head;
+    tx = start;
+    do {
+        if (node->tx_budget && sent >= node->tx_budget)
+            break;
+
+        if (tx->dirty || now - tx->last_sent >= node->tx_keepalive) {
+            // sequence runs 1..255, 0 would disable it at the receiver
+            sequence = tx->pkt.sequence;
+            tx->pkt.sequence = sequence == 255 ? 1 : sequence + 1;
+            length = (tx->pkt.lengthHi << 8) | tx->pkt.length;
+
+            // the broadcast address is read here, LAN_set_network may change it
+            if (LAN_sendto(node, tx->to.s_addr != 0 ? tx->to : node->bcast_addr,
+                    &tx->pkt, ARTNET_DMX_HEADER_SIZE + length) != ARTNET_EOK) {
+                // a failed send doesn't use up a sequence number
+                tx->pkt.sequence = sequence;
+                break;
+            }
+
+            tx->dirty = 0;
+            tx->last_sent = now;
+            sent++;
+        }
+
+        tx = tx->next != NULL ? tx->next : node->tx_head;
+    } while (tx != start);
+
+    node->tx_cursor = tx;
+    return sent;
 }
+#endif
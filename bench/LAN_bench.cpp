@@ -0,0 +1,295 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * bench.c
+ * Packet processing benchmark: feeds synthetic traffic from memory
+ * through LAN_recv/LAN_get_type/LAN_handle and reports throughput and
+ * latency. Host only, build from the library directory with:
+ *
+ *   g++ -O2 -I. -DARTNET_MAX_PAGES=16 bench/LAN_bench.cpp LAN*.cpp -o lan_bench
+ *   ./lan_bench [packets per corpus]
+ *
+ * Every port of the build is patched, port n to universe n.
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+enum { BENCH_UNIVERSES = 256 };
+enum { BENCH_CORPUS = 4096 };
+
+// latency histogram, 10 ns buckets up to 100 us
+enum { HIST_STEP_NS = 10 };
+enum { HIST_BUCKETS = 10000 };
+
+typedef struct {
+    uint32_t buckets[HIST_BUCKETS + 1];  // last one counts overflows
+    uint64_t count;
+    uint64_t max;
+} histogram_t;
+
+typedef struct {
+    uint8_t data[sizeof(artnet_packet_union_t)];
+    int length;
+    in_addr from;
+} frame_t;
+
+typedef struct {
+    frame_t *frames;
+    int nframes;
+    long remaining;     // packets left to hand out
+    long next;
+    uint64_t recv_ns;   // when the packet being handled was handed out
+    long sent;
+    uint8_t sequence[BENCH_UNIVERSES];
+} source_t;
+
+static histogram_t service;   // recv to next recv: whole dispatch
+static histogram_t delivery;  // recv to DMX callback
+static source_t source;
+static long callbacks;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void hist_add(histogram_t *h, uint64_t ns) {
+    uint64_t b = ns / HIST_STEP_NS;
+
+    h->buckets[b < HIST_BUCKETS ? b : (uint64_t) HIST_BUCKETS]++;
+    h->count++;
+    if (ns > h->max)
+        h->max = ns;
+}
+
+static uint64_t hist_percentile(const histogram_t *h, double pct) {
+    uint64_t target = (uint64_t) (h->count * pct / 100.0), seen = 0;
+    int i;
+
+    for (i = 0; i <= HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > target)
+            return i < HIST_BUCKETS ? (uint64_t) i * HIST_STEP_NS : h->max;
+    }
+    return h->max;
+}
+
+/*
+ * In-memory transport: hands out the corpus in a loop.
+ */
+static int source_recv(artnet_transport_t *t, void *buf, int size, in_addr *from) {
+    source_t *s = (source_t *) t->ctx;
+    frame_t *f;
+    uint64_t now = now_ns();
+
+    if (s->recv_ns)
+        hist_add(&service, now - s->recv_ns);
+
+    if (s->remaining <= 0) {
+        s->recv_ns = 0;
+        return ARTNET_ENODATA;
+    }
+
+    f = &s->frames[s->next];
+    s->next = (s->next + 1) % s->nframes;
+    s->remaining--;
+
+    memcpy(buf, f->data, f->length < size ? f->length : size);
+    *from = f->from;
+
+    // number the frames as a console would, the corpus repeats itself
+    if (f->length >= ARTNET_DMX_HEADER_SIZE && ((artnet_dmx_t *) f->data)->opCode == ARTNET_DMX) {
+        uint8_t *seq = &s->sequence[((artnet_dmx_t *) f->data)->universe % BENCH_UNIVERSES];
+        *seq = *seq == 255 ? 1 : *seq + 1;
+        ((artnet_dmx_t *) buf)->sequence = *seq;
+    }
+
+    s->recv_ns = now_ns();
+    return f->length;
+}
+
+static int source_send(artnet_transport_t *t, in_addr to, const void *buf, int length) {
+    (void) to;
+    (void) buf;
+    ((source_t *) t->ctx)->sent++;
+    return length;
+}
+
+static void on_dmx(const artnet_dmx_view_t *dmx) {
+    hist_add(&delivery, now_ns() - source.recv_ns);
+    callbacks += dmx->data[0] & 1;  // touch the data
+}
+
+static void make_dmx(frame_t *f, uint16_t universe, uint8_t sequence, uint8_t value) {
+    artnet_dmx_t *dmx = (artnet_dmx_t *) f->data;
+
+    memset(f->data, 0x00, sizeof(f->data));
+    memcpy(dmx->id, ARTNET_STRING, ARTNET_STRING_SIZE);
+    dmx->opCode = ARTNET_DMX;
+    dmx->ver = ARTNET_VERSION;
+    dmx->sequence = sequence;
+    dmx->universe = universe;
+    dmx->lengthHi = ARTNET_DMX_LENGTH >> 8;
+    dmx->length = ARTNET_DMX_LENGTH & 0xFF;
+    memset(dmx->data, value, ARTNET_DMX_LENGTH);
+    f->length = ARTNET_DMX_HEADER_SIZE + ARTNET_DMX_LENGTH;
+    f->from.s_addr = htonl(0x0A000001);
+}
+
+static void make_poll(frame_t *f, uint32_t controller) {
+    artnet_poll_t *poll = (artnet_poll_t *) f->data;
+
+    memset(f->data, 0x00, sizeof(f->data));
+    memcpy(poll->id, ARTNET_STRING, ARTNET_STRING_SIZE);
+    poll->opCode = ARTNET_POLL;
+    poll->ver = ARTNET_VERSION;
+    poll->ttm = ARTNET_TTM_DEFAULT;
+    f->length = sizeof(artnet_poll_t);
+    f->from.s_addr = htonl(0x0A000100 + controller);
+}
+
+static void make_garbage(frame_t *f, int kind) {
+    int i;
+
+    if (kind == 0) {
+        // random bytes
+        f->length = 1 + rand() % 600;
+        for (i = 0; i < f->length && i < (int) sizeof(f->data); i++)
+            f->data[i] = rand();
+    } else if (kind == 1) {
+        // truncated ArtDmx
+        make_dmx(f, rand() % BENCH_UNIVERSES, 0, 0);
+        f->length = 10 + rand() % ARTNET_DMX_HEADER_SIZE;
+    } else {
+        // valid id, unknown opcode
+        make_poll(f, 0);
+        ((artnet_poll_t *) f->data)->opCode = 0x1234;
+    }
+    if (f->length > (int) sizeof(f->data))
+        f->length = sizeof(f->data);
+    f->from.s_addr = htonl(0x0A000200);
+}
+
+// DMX for the universes of the node, all of it is delivered
+static void corpus_dmx(frame_t *frames, int n) {
+    for (int i = 0; i < n; i++)
+        make_dmx(&frames[i], i % ARTNET_MAX_NODE_PORTS, 1 + (i / ARTNET_MAX_NODE_PORTS) % 255, i);
+}
+
+// DMX over many universes, most of which the node rejects
+static void corpus_reject(frame_t *frames, int n) {
+    for (int i = 0; i < n; i++)
+        make_dmx(&frames[i], i % BENCH_UNIVERSES, 1 + (i / BENCH_UNIVERSES) % 255, i);
+}
+
+static void corpus_poll(frame_t *frames, int n) {
+    for (int i = 0; i < n; i++)
+        make_poll(&frames[i], i % 200);
+}
+
+static void corpus_garbage(frame_t *frames, int n) {
+    for (int i = 0; i < n; i++)
+        make_garbage(&frames[i], i % 3);
+}
+
+static void corpus_mixed(frame_t *frames, int n) {
+    for (int i = 0; i < n; i++) {
+        int r = rand() % 10;
+        if (r < 7)
+            make_dmx(&frames[i], rand() % 8, 1 + (i / 8) % 255, i);
+        else if (r < 8)
+            make_poll(&frames[i], rand() % 20);
+        else
+            make_garbage(&frames[i], rand() % 3);
+    }
+}
+
+static void run(const char *name, void (*fill)(frame_t *, int), long packets) {
+    static frame_t frames[BENCH_CORPUS];
+    static artnet_node_t node;
+    static artnet_packet_t slot;
+    artnet_transport_t transport;
+    uint8_t mac[ARTNET_MAC_SIZE] = { 0 };
+    in_addr ip, any;
+    artnet_stats_t stats;
+    uint64_t start, elapsed;
+    int port;
+
+    srand(1);
+    fill(frames, BENCH_CORPUS);
+
+    memset(&service, 0x00, sizeof(service));
+    memset(&delivery, 0x00, sizeof(delivery));
+    memset(&source, 0x00, sizeof(source));
+    source.frames = frames;
+    source.nframes = BENCH_CORPUS;
+    source.remaining = packets;
+    callbacks = 0;
+
+    transport.recv = source_recv;
+    transport.send = source_send;
+    transport.ctx = &source;
+
+    ip.s_addr = htonl(0x0A000002);
+    any.s_addr = htonl(0x0A0000FF);
+    LAN_init(&node);
+    LAN_set_network(&node, ip, any, any, any, mac);
+    LAN_set_transport(&node, &transport);
+    for (port = 0; port < ARTNET_MAX_NODE_PORTS; port++) {
+        if (port % ARTNET_MAX_PORTS == 0)
+            LAN_set_page(&node, port / ARTNET_MAX_PORTS, port >> 8, (port >> 4) & 0x0F);
+        LAN_set_port_universe(&node, port, port);
+        LAN_set_dmx_view_callback(&node, port, on_dmx);
+    }
+
+    start = now_ns();
+    while (source.remaining > 0)
+        LAN_read(&node, &slot);
+    elapsed = now_ns() - start;
+    LAN_get_stats(&node, &stats);
+
+    printf("%-8s %10ld pkts %8.0f kpps, %8llu delivered %8llu rejected"
+           " | service p50 %6llu p99 %6llu max %8llu ns"
+           " | callback p50 %6llu p99 %6llu max %8llu ns\n",
+           name, packets, packets * 1e6 / elapsed, (unsigned long long) delivery.count,
+           (unsigned long long) (stats.rx_malformed + stats.rx_unsubscribed + stats.dmx_stale),
+           (unsigned long long) hist_percentile(&service, 50),
+           (unsigned long long) hist_percentile(&service, 99),
+           (unsigned long long) service.max,
+           (unsigned long long) hist_percentile(&delivery, 50),
+           (unsigned long long) hist_percentile(&delivery, 99),
+           (unsigned long long) delivery.max);
+
+    printf("%-8s dmx %u poll %u other %u malformed %u unsubscribed %u stale %u\n",
+           "", stats.rx_opcode[ARTNET_STAT_DMX], stats.rx_opcode[ARTNET_STAT_POLL],
+           stats.rx_opcode[ARTNET_STAT_OTHER], stats.rx_malformed,
+           stats.rx_unsubscribed, stats.dmx_stale);
+}
+
+int main(int argc, char **argv) {
+    long packets = argc > 1 ? atol(argv[1]) : 1000000;
+
+    run("dmx", corpus_dmx, packets);
+    run("reject", corpus_reject, packets);
+    run("poll", corpus_poll, packets);
+    run("garbage", corpus_garbage, packets);
+    run("mixed", corpus_mixed, packets);
+    return 0;
+}
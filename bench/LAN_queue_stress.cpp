@@ -0,0 +1,134 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *
+ * queue_stress.c
+ * Frame queue stress test: a producer thread publishes numbered frames
+ * while the main thread polls them without sleeping, and checks that
+ * every frame read is whole and newer than the previous one. The
+ * producer never gets more than STRESS_LEAD frames ahead of the reader,
+ * so reads keep overlapping writes, and the test fails when fewer than
+ * one frame in STRESS_MIN_RATIO is read. Host only, build from the
+ * library directory with:
+ *
+ *   g++ -O2 -pthread -I. bench/LAN_queue_stress.cpp LAN*.cpp -o lan_queue_stress
+ *   ./lan_queue_stress [frames]
+ */
+
+#include "LAN.h"
+#include "LAN_common.h"
+
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+
+enum { STRESS_PORT = 3 };
+enum { STRESS_LEAD = 4 };
+enum { STRESS_MIN_RATIO = 10 };
+
+static artnet_node_t node;
+static artnet_frame_queue_t queue;
+static std::atomic<bool> done(false);
+static std::atomic<uint32_t> consumed(0);  // number of the last frame read, + 1
+
+/*
+ * Frame k: k in the first 4 slots, then slot i holds k + i, universe,
+ * length and sequence follow from k, so a torn frame can't pass for a
+ * whole one.
+ */
+static uint16_t frame_length(uint32_t k) {
+    return sizeof(k) + (k % 255) * 2;
+}
+
+static void produce(uint32_t frames) {
+    static uint8_t data[ARTNET_DMX_LENGTH];
+    artnet_dmx_view_t view;
+    uint32_t k;
+    uint16_t i;
+
+    memset(&view, 0x00, sizeof(view));
+    view.data = data;
+    view.port = STRESS_PORT;
+
+    for (k = 0; k < frames; k++) {
+        view.length = frame_length(k);
+        memcpy(data, &k, sizeof(k));
+        for (i = sizeof(k); i < view.length; i++)
+            data[i] = k + i;
+        view.universe = k & ARTNET_PORT_ADDRESS_MASK;
+        view.sequence = (k & 0x7F) + 1;
+        LAN_queue_publish(&queue, &view);
+
+        // let the reader catch up, yield for single core hosts
+        while (k >= consumed + STRESS_LEAD)
+            std::this_thread::yield();
+    }
+    done = true;
+}
+
+/*
+ * Returns the number of bad frames in view, k is set to its number
+ */
+static int check(const artnet_dmx_view_t *view, uint32_t *k) {
+    uint16_t i;
+
+    memcpy(k, view->data, sizeof(*k));
+    if (view->port != STRESS_PORT || view->length != frame_length(*k)
+            || view->universe != (*k & ARTNET_PORT_ADDRESS_MASK)
+            || view->sequence != (*k & 0x7F) + 1)
+        return 1;
+    for (i = sizeof(*k); i < view->length; i++) {
+        if (view->data[i] != (uint8_t) (*k + i))
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t frames = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    artnet_dmx_view_t view;
+    uint32_t k, last = 0;
+    long reads = 0, bad = 0, backwards = 0;
+    bool first = true, finished;
+
+    LAN_init(&node);
+    LAN_set_port_queue(&node, STRESS_PORT, &queue);
+
+    std::thread producer(produce, frames);
+    do {
+        // read done first, the last frame is published before it is set
+        finished = done;
+        while (LAN_queue_read(&queue, &view)) {
+            reads++;
+            bad += check(&view, &k);
+            if (!first && k <= last)
+                backwards++;
+            last = k;
+            first = false;
+            consumed = k + 1;
+        }
+        std::this_thread::yield();
+    } while (!finished);
+    producer.join();
+
+    printf("%-10s published %10u read %10ld bad %ld backwards %ld last %s\n", "queue",
+           frames, reads, bad, backwards,
+           frames == 0 || last == frames - 1 ? "ok" : "missing");
+    if (reads < (long) (frames / STRESS_MIN_RATIO))
+        printf("%-10s too few reads to exercise the exchange\n", "");
+
+    return bad || backwards || (frames > 0 && last != frames - 1)
+        || reads < (long) (frames / STRESS_MIN_RATIO);
+}
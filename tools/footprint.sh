@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# Size of the library for each feature configuration: flash (text+data),
+# static RAM (data+bss) and the size of a node and of a receive packet.
+#
+# Uses the host compiler by default. For the target, point CXX at the
+# cross compiler and add the mbed include flags, e.g.
+#   CXX=arm-none-eabi-g++ \
+#   CXXFLAGS="-mcpu=cortex-m3 -mthumb -Os -D__MBED__ -I..." tools/footprint.sh
+
+set -e
+
+cd "$(dirname "$0")/.."
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--Os}
+PREFIX=${CXX%g++}
+SIZE=${SIZE:-${PREFIX}size}
+NM=${NM:-${PREFIX}nm}
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+cat > "$OUT/probe.cpp" <<PROBE
+#include "LAN.h"
+char footprint_node[sizeof(artnet_node_t)];
+char footprint_packet[sizeof(artnet_packet_t)];
+PROBE
+
+symbol_size() {
+    printf '%d' "0x$($NM -S "$OUT/probe.o" | awk -v s="$1" '$4 == s { print $2 }')"
+}
+
+report() {
+    name=$1
+    flags=$2
+    rm -f "$OUT"/*.o
+    for src in LAN*.cpp; do
+        $CXX $CXXFLAGS -std=gnu++11 -I. $flags -c "$src" -o "$OUT/${src%.cpp}.o"
+    done
+    $CXX $CXXFLAGS -std=gnu++11 -I. $flags -c "$OUT/probe.cpp" -o "$OUT/probe.o"
+    set -- $($SIZE -t "$OUT"/LAN*.o | tail -1)
+    printf '%-12s %8d %8d %8d %8d\n' "$name" $(($1 + $2)) $(($2 + $3)) \
+        "$(symbol_size footprint_node)" "$(symbol_size footprint_packet)"
+}
+
+printf '%-12s %8s %8s %8s %8s\n' config flash ram node packet
+
+report none ""
+report input "-DARTNET_FEATURE_INPUT"
+report tod "-DARTNET_FEATURE_TOD"
+report rdm "-DARTNET_FEATURE_TOD -DARTNET_FEATURE_RDM"
+report firmware "-DARTNET_FEATURE_FIRMWARE"
+report pcap "-DARTNET_FEATURE_PCAP"
+report all "-DARTNET_FEATURE_INPUT -DARTNET_FEATURE_TOD -DARTNET_FEATURE_RDM -DARTNET_FEATURE_FIRMWARE"
+report pages8 "-DARTNET_MAX_PAGES=8"